@@ -0,0 +1,521 @@
+/*
+ * Headless benchmark driver for mutt
+ *
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * mutt_bench: a headless driver for the mailbox hot paths.
+ *
+ * It is linked against the same objects as mutt itself (main.c is built
+ * with MUTT_BENCH so that its main() drops out) and can either generate
+ * a synthetic mailbox or time open, sort, thread, limit, search and sync
+ * on an existing one.  Results are printed one stage per line as
+ *
+ *	<stage> <messages> <seconds>
+ *
+ * where seconds is the best of the requested number of runs.
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mutt_curses.h"
+#include "mailbox.h"
+#include "mapping.h"
+#include "mx.h"
+#include "sort.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <locale.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#ifdef HAVE_GETOPT_H
+#include <getopt.h>
+#endif
+
+static unsigned int BenchSeed = 1;
+
+/* a small deterministic generator, so that corpora are reproducible */
+static unsigned int bench_rand (unsigned int n)
+{
+  BenchSeed = BenchSeed * 1103515245 + 12345;
+  return ((BenchSeed >> 16) & 0x7fff) % n;
+}
+
+static double bench_now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void bench_quiet (const char *fmt, ...)
+{
+}
+
+static void bench_report (const char *stage, int msgs, double secs)
+{
+  printf ("%s %d %.6f\n", stage, msgs, secs);
+  fflush (stdout);
+}
+
+static const char *Words[] = {
+  "mail", "thread", "header", "cache", "index", "pager", "sort", "limit",
+  "search", "mailbox", "message", "reply", "folder", "patch", "review",
+  "build", "release", "fix", "crash", "speed", NULL
+};
+#define NWORDS (sizeof (Words) / sizeof (Words[0]) - 1)
+
+struct bench_charset
+{
+  const char *name;
+  const char *word;	/* a non-ascii word in that charset */
+  const char *qword;	/* the same word, RFC2047 Q-encoded */
+};
+
+static const struct bench_charset Charsets[] = {
+  { "us-ascii",   "plain",           "plain" },
+  { "utf-8",      "caf\303\251",     "caf=C3=A9" },
+  { "iso-8859-1", "caf\351",         "caf=E9" },
+  { "koi8-r",     "\322\301\302",    "=D2=C1=C2" },
+  { NULL, NULL, NULL }
+};
+
+static void bench_write_body (FILE *fp, const struct bench_charset *cs,
+			      int depth, int n)
+{
+  int i, lines;
+
+  if (depth > 0)
+  {
+    fprintf (fp, "Content-Type: multipart/mixed; boundary=\"b%d-%d\"\n\n", n, depth);
+    fprintf (fp, "This is a multi-part message in MIME format.\n");
+    fprintf (fp, "--b%d-%d\n", n, depth);
+    bench_write_body (fp, cs, depth - 1, n);
+    fprintf (fp, "--b%d-%d\n", n, depth);
+    fprintf (fp, "Content-Type: application/octet-stream\n");
+    fprintf (fp, "Content-Transfer-Encoding: base64\n");
+    fprintf (fp, "Content-Disposition: attachment; filename=\"part%d.bin\"\n\n", depth);
+    for (i = 0; i < 4; i++)
+      fprintf (fp, "QmVuY2htYXJrIGF0dGFjaG1lbnQgZGF0YSwgcmVwZWF0ZWQgdG8gZmlsbCB0aGUgbGluZS4K\n");
+    fprintf (fp, "--b%d-%d--\n", n, depth);
+    return;
+  }
+
+  fprintf (fp, "Content-Type: text/plain; charset=%s\n", cs->name);
+  fprintf (fp, "Content-Transfer-Encoding: 8bit\n\n");
+  lines = 5 + bench_rand (40);
+  for (i = 0; i < lines; i++)
+  {
+    if (i && !bench_rand (6))
+      fputs ("> ", fp);
+    fprintf (fp, "%s %s %s %s line %d\n", Words[bench_rand (NWORDS)],
+	     cs->word, Words[bench_rand (NWORDS)], Words[bench_rand (NWORDS)], i);
+  }
+}
+
+static void bench_write_message (FILE *fp, const struct bench_charset *cs,
+				 int n, int thread, int depth)
+{
+  int parent, from;
+  time_t t = 1483228800 + n * 3600 + bench_rand (3600);
+  char date[SHORT_STRING];
+
+  /* messages are grouped into threads of the given size; each reply
+   * points at a random earlier message of the same thread */
+  parent = (thread > 1 && n % thread) ? n - 1 - bench_rand (n % thread) : -1;
+  from = bench_rand (50);
+
+  strftime (date, sizeof (date), "Date: %a, %d %b %Y %H:%M:%S +0000\n", gmtime (&t));
+  fputs (date, fp);
+  fprintf (fp, "From: User %d <user%d@example.com>\n", from, from);
+  fprintf (fp, "To: list@example.com\n");
+  if (bench_rand (4) == 0)
+    fprintf (fp, "Cc: user%d@example.org\n", bench_rand (50));
+  if (parent >= 0)
+    fprintf (fp, "Subject: Re: =?%s?Q?%s?= %s %d\n", cs->name, cs->qword,
+	     Words[(n / thread) % NWORDS], n / thread);
+  else
+    fprintf (fp, "Subject: =?%s?Q?%s?= %s %d\n", cs->name, cs->qword,
+	     Words[(n / thread) % NWORDS], thread > 1 ? n / thread : n);
+  fprintf (fp, "Message-ID: <%d.bench@example.com>\n", n);
+  if (parent >= 0)
+  {
+    fprintf (fp, "In-Reply-To: <%d.bench@example.com>\n", parent);
+    fprintf (fp, "References: <%d.bench@example.com>\n", parent);
+  }
+  fprintf (fp, "MIME-Version: 1.0\n");
+  bench_write_body (fp, cs, depth, n);
+}
+
+static int bench_generate (const char *type, const char *path, int count,
+			   int thread, int depth, const char *charset)
+{
+  const struct bench_charset *cs;
+  char file[_POSIX_PATH_MAX];
+  FILE *fp = NULL;
+  int i, magic;
+
+  for (cs = Charsets; cs->name; cs++)
+    if (!ascii_strcasecmp (cs->name, charset))
+      break;
+  if (!cs->name)
+  {
+    fprintf (stderr, "mutt_bench: unknown charset %s\n", charset);
+    return 1;
+  }
+
+  if (!ascii_strcasecmp (type, "mbox"))
+    magic = MUTT_MBOX;
+  else if (!ascii_strcasecmp (type, "maildir"))
+    magic = MUTT_MAILDIR;
+  else if (!ascii_strcasecmp (type, "mh"))
+    magic = MUTT_MH;
+  else
+  {
+    fprintf (stderr, "mutt_bench: unknown mailbox type %s\n", type);
+    return 1;
+  }
+
+  if (magic == MUTT_MBOX)
+  {
+    if ((fp = safe_fopen (path, "w")) == NULL)
+    {
+      mutt_perror (path);
+      return 1;
+    }
+  }
+  else
+  {
+    if (mkdir (path, 0700) == -1 && errno != EEXIST)
+    {
+      mutt_perror (path);
+      return 1;
+    }
+    if (magic == MUTT_MAILDIR)
+    {
+      snprintf (file, sizeof (file), "%s/cur", path);
+      mkdir (file, 0700);
+      snprintf (file, sizeof (file), "%s/new", path);
+      mkdir (file, 0700);
+      snprintf (file, sizeof (file), "%s/tmp", path);
+      mkdir (file, 0700);
+    }
+    else
+    {
+      snprintf (file, sizeof (file), "%s/.mh_sequences", path);
+      if ((fp = safe_fopen (file, "w")) != NULL)
+	safe_fclose (&fp);
+    }
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    if (magic == MUTT_MBOX)
+    {
+      fprintf (fp, "From user@example.com Sun Jan  1 00:00:00 2017\n");
+      bench_write_message (fp, cs, i, thread, depth);
+      fputc ('\n', fp);
+      continue;
+    }
+
+    if (magic == MUTT_MAILDIR)
+      snprintf (file, sizeof (file), "%s/cur/%d.bench:2,%s", path, i,
+		bench_rand (3) ? "S" : "");
+    else
+      snprintf (file, sizeof (file), "%s/%d", path, i + 1);
+    if ((fp = safe_fopen (file, "w")) == NULL)
+    {
+      mutt_perror (file);
+      return 1;
+    }
+    bench_write_message (fp, cs, i, thread, depth);
+    safe_fclose (&fp);
+  }
+
+  if (fp && safe_fclose (&fp) != 0)
+  {
+    mutt_perror (path);
+    return 1;
+  }
+
+  return 0;
+}
+
+/* time `what' on each header of ctx, like mutt_pattern_func() but without
+ * touching the limit */
+static int bench_search (CONTEXT *ctx, const char *what)
+{
+  pattern_t *pat;
+  BUFFER err;
+  char buf[LONG_STRING];
+  int i, n = 0;
+
+  strfcpy (buf, what, sizeof (buf));
+  mutt_check_simple (buf, sizeof (buf), NONULL (SimpleSearch));
+  memset (&err, 0, sizeof (err));
+  err.dsize = STRING;
+  err.data = safe_malloc (err.dsize);
+  if ((pat = mutt_pattern_comp (buf, MUTT_FULL_MSG, &err)) == NULL)
+  {
+    mutt_error ("%s", err.data);
+    FREE (&err.data);
+    return -1;
+  }
+  for (i = 0; i < ctx->msgcount; i++)
+    if (mutt_pattern_exec (pat, MUTT_MATCH_FULL_ADDRESS, ctx, ctx->hdrs[i]))
+      n++;
+  mutt_pattern_free (&pat);
+  FREE (&err.data);
+  return n;
+}
+
+static int bench_run (const char *path, int runs, const char *limit,
+		      const char *search, int do_sync)
+{
+  const struct mapping_t *m, *p;
+  CONTEXT *ctx;
+  double t, best;
+  int i, count = 0, index_hint;
+  short sort = Sort;
+  char stage[SHORT_STRING];
+
+  /* open */
+  best = -1;
+  for (i = 0; i < runs; i++)
+  {
+    t = bench_now ();
+    if ((ctx = mx_open_mailbox (path, MUTT_READONLY | MUTT_QUIET, NULL)) == NULL)
+    {
+      fprintf (stderr, "mutt_bench: can't open %s\n", path);
+      return 1;
+    }
+    t = bench_now () - t;
+    if (best < 0 || t < best)
+      best = t;
+    count = ctx->msgcount;
+    if (i + 1 < runs)
+    {
+      mx_close_mailbox (ctx, NULL);
+      FREE (&ctx);
+    }
+  }
+  bench_report ("open", count, best);
+
+  Context = ctx;
+  ctx->quiet = 1;
+
+  /* sort by each method; "threads" is reported as the thread stage */
+  for (m = SortMethods; m->name; m++)
+  {
+    for (p = SortMethods; p != m && p->value != m->value; p++)
+      ;
+    if (p != m)
+      continue;		/* an alias of an earlier method */
+
+    Sort = m->value;
+    best = -1;
+    for (i = 0; i < runs; i++)
+    {
+      t = bench_now ();
+      mutt_sort_headers (ctx, 1);
+      t = bench_now () - t;
+      if (best < 0 || t < best)
+	best = t;
+    }
+    if (m->value == SORT_THREADS)
+      strfcpy (stage, "thread", sizeof (stage));
+    else
+      snprintf (stage, sizeof (stage), "sort-%s", m->name);
+    bench_report (stage, count, best);
+  }
+  Sort = sort;
+  mutt_sort_headers (ctx, 1);
+
+  /* limit, through the same code path as <limit> */
+  best = -1;
+  for (i = 0; i < runs; i++)
+  {
+    mutt_str_replace (&ctx->pattern, limit);
+    t = bench_now ();
+    mutt_pattern_func (MUTT_LIMIT, NULL);
+    t = bench_now () - t;
+    if (best < 0 || t < best)
+      best = t;
+  }
+  bench_report ("limit", ctx->vcount, best);
+  mutt_str_replace (&ctx->pattern, "~A");
+  mutt_pattern_func (MUTT_LIMIT, NULL);
+
+  /* search */
+  best = -1;
+  for (i = 0; i < runs; i++)
+  {
+    t = bench_now ();
+    count = bench_search (ctx, search);
+    t = bench_now () - t;
+    if (best < 0 || t < best)
+      best = t;
+  }
+  bench_report ("search", count, best);
+
+  mx_close_mailbox (ctx, NULL);
+  FREE (&ctx);
+  Context = NULL;
+
+  if (!do_sync)
+    return 0;
+
+  /* sync: toggle the flagged state of every tenth message and write the
+   * mailbox back.  This modifies the mailbox. */
+  best = -1;
+  for (i = 0; i < runs; i++)
+  {
+    int j;
+
+    if ((ctx = mx_open_mailbox (path, MUTT_QUIET, NULL)) == NULL)
+    {
+      fprintf (stderr, "mutt_bench: can't open %s\n", path);
+      return 1;
+    }
+    Context = ctx;
+    for (j = 0, count = 0; j < ctx->msgcount; j += 10, count++)
+      mutt_set_flag (ctx, ctx->hdrs[j], MUTT_FLAG, !ctx->hdrs[j]->flagged);
+    index_hint = 0;
+    t = bench_now ();
+    if (mx_sync_mailbox (ctx, &index_hint) != 0)
+    {
+      fprintf (stderr, "mutt_bench: sync of %s failed\n", path);
+      mx_fastclose_mailbox (ctx);
+      FREE (&ctx);
+      return 1;
+    }
+    t = bench_now () - t;
+    if (best < 0 || t < best)
+      best = t;
+    mx_close_mailbox (ctx, NULL);
+    FREE (&ctx);
+    Context = NULL;
+  }
+  bench_report ("sync", count, best);
+
+  return 0;
+}
+
+static void bench_usage (void)
+{
+  puts ("usage: mutt_bench [-n] [-F <muttrc>] [-r <runs>] [-l <pattern>] [-s <pattern>] [-S] -f <mailbox>\n\
+       mutt_bench -g mbox|maildir|mh [-m <messages>] [-t <thread size>]\n\
+                  [-d <mime depth>] [-c <charset>] -f <mailbox>\n\
+options:\n\
+  -c <charset>\tcharset of generated messages (us-ascii, utf-8, iso-8859-1, koi8-r)\n\
+  -d <depth>\tnesting of multipart/mixed in generated messages (default: 0)\n\
+  -F <file>\tspecify an alternate muttrc file\n\
+  -f <file>\tthe mailbox to generate or measure\n\
+  -g <type>\tgenerate a synthetic mailbox of the given type\n\
+  -l <pattern>\tlimit pattern to time (default: ~f user1)\n\
+  -m <count>\tnumber of messages to generate (default: 1000)\n\
+  -n\t\tcauses Mutt not to read the system Muttrc\n\
+  -r <runs>\trepeat each stage and report the best time (default: 1)\n\
+  -S\t\talso time a flag sync (modifies the mailbox)\n\
+  -s <pattern>\tsearch pattern to time (default: ~b release)\n\
+  -t <size>\tmessages per thread in generated mailboxes (default: 5)");
+}
+
+int main (int argc, char **argv)
+{
+  char folder[_POSIX_PATH_MAX] = "";
+  const char *gen = NULL, *charset = "us-ascii";
+  const char *limit = "~f user1", *search = "~b release";
+  int count = 1000, thread = 5, depth = 0, runs = 1, do_sync = 0;
+  int skip_sys_rc = 0;
+  int i;
+
+  setlocale (LC_ALL, "");
+
+  mutt_error = mutt_nocurses_error;
+  mutt_message = bench_quiet;
+  umask (077);
+
+  while ((i = getopt (argc, argv, "c:d:F:f:g:l:m:nr:Ss:t:")) != EOF)
+  {
+    switch (i)
+    {
+      case 'c':
+	charset = optarg;
+	break;
+      case 'd':
+	depth = atoi (optarg);
+	break;
+      case 'F':
+	mutt_str_replace (&Muttrc, optarg);
+	break;
+      case 'f':
+	strfcpy (folder, optarg, sizeof (folder));
+	break;
+      case 'g':
+	gen = optarg;
+	break;
+      case 'l':
+	limit = optarg;
+	break;
+      case 'm':
+	count = atoi (optarg);
+	break;
+      case 'n':
+	skip_sys_rc = 1;
+	break;
+      case 'r':
+	runs = atoi (optarg);
+	break;
+      case 'S':
+	do_sync = 1;
+	break;
+      case 's':
+	search = optarg;
+	break;
+      case 't':
+	thread = atoi (optarg);
+	break;
+      default:
+	bench_usage ();
+	return 1;
+    }
+  }
+
+  if (!folder[0] || count < 0 || thread < 1 || depth < 0 || runs < 1)
+  {
+    bench_usage ();
+    return 1;
+  }
+
+  if (gen)
+    return bench_generate (gen, folder, count, thread, depth, charset);
+
+  set_option (OPTNOCURSES);
+  mutt_init_windows ();
+  mutt_init (skip_sys_rc, NULL);
+
+  mutt_expand_path (folder, sizeof (folder));
+  return bench_run (folder, runs, limit, search, do_sync);
+}
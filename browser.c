@@ -77,6 +77,32 @@ typedef struct folder_t
   int num;
 } FOLDER;
 
+/* Names of the directories already read, so that going back and forth
+ * in a large tree does not readdir() them again. A directory is read
+ * again once its mtime changes. Only the names and file types are kept:
+ * writing to a file does not touch the directory, so the rest comes
+ * from lstat() every time, and only for the entries drawn unless the
+ * sort needs it (see browser_stat). */
+#define BROWSER_DIR_CACHE 16
+
+struct dir_cache
+{
+  char *path;
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;		/* of the directory when it was read */
+  time_t read;		/* when it was read */
+  char **names;
+  mode_t *types;	/* S_IFMT bits from readdir(), 0 if unknown */
+  int num, max;
+  struct dir_cache *next;
+};
+
+static struct dir_cache *DirCache = NULL;
+
+/* the directory examine_directory last listed */
+static char BrowseDir[_POSIX_PATH_MAX] = "";
+
 static char OldLastDir[_POSIX_PATH_MAX] = "";
 static char LastDir[_POSIX_PATH_MAX] = "";
 static char LastDirBackup[_POSIX_PATH_MAX] = "";
@@ -210,8 +236,30 @@ static int browser_compare (const void *a, const void *b)
 /* Call to qsort using browser_compare function. Some
  * specific sort methods are not used via NNTP.
  */
+/* browser_stat: fill in an entry of BrowseDir which so far only has its
+ *   file type from readdir() */
+static void browser_stat (struct folder_file *ff)
+{
+  char buffer[_POSIX_PATH_MAX + SHORT_STRING];
+  struct stat s;
+
+  ff->stat_pending = 0;
+  mutt_concat_path (buffer, BrowseDir, ff->name, sizeof (buffer));
+  if (lstat (buffer, &s) == -1)
+    return;
+
+  ff->mode = s.st_mode;
+  ff->mtime = s.st_mtime;
+  ff->size = s.st_size;
+  ff->gid = s.st_gid;
+  ff->uid = s.st_uid;
+  ff->nlink = s.st_nlink;
+}
+
 static void browser_sort (struct browser_state *state)
 {
+  unsigned int i;
+
   switch (BrowserSort & SORT_MASK)
   {
     /* Also called "I don't care"-sort-method. */
@@ -223,6 +271,10 @@ static void browser_sort (struct browser_state *state)
       if (option (OPTNEWS))
         return;
 #endif
+      for (i = 0; i < state->entrylen; i++)
+	if (state->entry[i].stat_pending)
+	  browser_stat (&state->entry[i]);
+      break;
     default:
       break;
   }
@@ -230,6 +282,110 @@ static void browser_sort (struct browser_state *state)
   qsort (state->entry, state->entrylen, sizeof (struct folder_file), browser_compare);
 }
 
+static void dir_cache_free (struct dir_cache **dc)
+{
+  int i;
+
+  for (i = 0; i < (*dc)->num; i++)
+    FREE (&(*dc)->names[i]);
+  FREE (&(*dc)->names);
+  FREE (&(*dc)->types);
+  FREE (&(*dc)->path);
+  FREE (dc);		/* __FREE_CHECKED__ */
+}
+
+/* dir_cache_get: return the names in directory d, whose stat is s,
+ *   reading it unless a cached copy is still current. The directory
+ *   mtime only has a resolution of a second, so a copy read during the
+ *   second of the last change is not trusted. */
+static struct dir_cache *dir_cache_get (const char *d, const struct stat *s)
+{
+  struct dir_cache **p, *dc;
+  DIR *dp;
+  struct dirent *de;
+  int n = 0;
+
+  for (p = &DirCache; *p; p = &(*p)->next)
+  {
+    if (mutt_strcmp ((*p)->path, d))
+      continue;
+
+    dc = *p;
+    *p = dc->next;
+    if (dc->dev == s->st_dev && dc->ino == s->st_ino &&
+	dc->mtime == s->st_mtime && dc->read > s->st_mtime)
+    {
+      dc->next = DirCache;
+      DirCache = dc;
+      return dc;
+    }
+    dir_cache_free (&dc);
+    break;
+  }
+
+  if ((dp = opendir (d)) == NULL)
+    return NULL;
+
+  dc = safe_calloc (1, sizeof (struct dir_cache));
+  dc->path = safe_strdup (d);
+  dc->dev = s->st_dev;
+  dc->ino = s->st_ino;
+  dc->mtime = s->st_mtime;
+  dc->read = time (NULL);
+
+  while ((de = readdir (dp)) != NULL)
+  {
+    if (mutt_strcmp (de->d_name, ".") == 0)
+      continue;    /* we don't need . */
+
+    if (dc->num == dc->max)
+    {
+      dc->max += 256;
+      safe_realloc (&dc->names, sizeof (char *) * dc->max);
+      safe_realloc (&dc->types, sizeof (mode_t) * dc->max);
+    }
+    dc->types[dc->num] = 0;
+#ifdef DT_DIR
+    switch (de->d_type)
+    {
+      case DT_REG:
+	dc->types[dc->num] = S_IFREG;
+	break;
+      case DT_DIR:
+	dc->types[dc->num] = S_IFDIR;
+	break;
+      case DT_LNK:
+	dc->types[dc->num] = S_IFLNK;
+	break;
+      case DT_UNKNOWN:
+	break;
+      default:
+	dc->types[dc->num] = S_IFIFO;	/* anything we don't list */
+    }
+#endif
+    dc->names[dc->num++] = safe_strdup (de->d_name);
+  }
+  closedir (dp);
+
+  dc->next = DirCache;
+  DirCache = dc;
+
+  /* drop the least recently used directories */
+  for (p = &DirCache; *p; p = &(*p)->next)
+    if (++n == BROWSER_DIR_CACHE)
+    {
+      while ((*p)->next)
+      {
+	dc = (*p)->next;
+	(*p)->next = dc->next;
+	dir_cache_free (&dc);
+      }
+      break;
+    }
+
+  return DirCache;
+}
+
 static int link_is_dir (const char *folder, const char *path)
 {
   struct stat st;
@@ -644,10 +800,12 @@ static int examine_directory (MUTTMENU *menu, struct browser_state *state,
 #endif /* USE_NNTP */
   {
   struct stat s;
-  DIR *dp;
-  struct dirent *de;
+  struct dir_cache *dc;
+  const char *name;
   char buffer[_POSIX_PATH_MAX + SHORT_STRING];
   BUFFY *tmp;
+  HASH *incoming = NULL;
+  int i;
 
   while (stat (d, &s) == -1)
   {
@@ -674,44 +832,60 @@ static int examine_directory (MUTTMENU *menu, struct browser_state *state,
 
   mutt_buffy_check (0);
 
-  if ((dp = opendir (d)) == NULL)
+  if ((dc = dir_cache_get (d, &s)) == NULL)
   {
     mutt_perror (d);
     return (-1);
   }
+  strfcpy (BrowseDir, d, sizeof (BrowseDir));
 
   init_state (state, menu);
 
-  while ((de = readdir (dp)) != NULL)
+  /* look the mailboxes up by path rather than walking the whole list
+   * for every entry */
+  if (Incoming)
   {
-    if (mutt_strcmp (de->d_name, ".") == 0)
-      continue;    /* we don't need . */
-    
-    if (prefix && *prefix && mutt_strncmp (prefix, de->d_name, mutt_strlen (prefix)) != 0)
+    incoming = hash_create (256, 0);
+    for (tmp = Incoming; tmp; tmp = tmp->next)
+      hash_insert (incoming, tmp->path, tmp, 0);
+  }
+
+  for (i = 0; i < dc->num; i++)
+  {
+    name = dc->names[i];
+
+    if (prefix && *prefix && mutt_strncmp (prefix, name, mutt_strlen (prefix)) != 0)
       continue;
-    if (!((regexec (Mask.rx, de->d_name, 0, NULL, 0) == 0) ^ Mask.not))
+    if (!((regexec (Mask.rx, name, 0, NULL, 0) == 0) ^ Mask.not))
       continue;
 
-    mutt_concat_path (buffer, d, de->d_name, sizeof (buffer));
-    if (lstat (buffer, &s) == -1)
+    mutt_concat_path (buffer, d, name, sizeof (buffer));
+    /* with the type from readdir() the lstat() can wait until the entry
+     * is drawn */
+    if (dc->types[i])
+    {
+      memset (&s, 0, sizeof (s));
+      s.st_mode = dc->types[i];
+    }
+    else if (lstat (buffer, &s) == -1)
       continue;
     
     if ((! S_ISREG (s.st_mode)) && (! S_ISDIR (s.st_mode)) &&
 	(! S_ISLNK (s.st_mode)))
       continue;
     
-    tmp = Incoming;
-    while (tmp && mutt_strcmp (buffer, tmp->path))
-      tmp = tmp->next;
+    tmp = incoming ? hash_find (incoming, buffer) : NULL;
     if (tmp && Context &&
         !mutt_strcmp (tmp->realpath, Context->realpath))
     {
       tmp->msg_count = Context->msgcount;
       tmp->msg_unread = Context->unread;
     }
-    add_folder (menu, state, de->d_name, NULL, &s, tmp, NULL);
+    add_folder (menu, state, name, NULL, &s, tmp, NULL);
+    state->entry[state->entrylen - 1].stat_pending = dc->types[i] != 0;
   }
-  closedir (dp);  
+  if (incoming)
+    hash_destroy (&incoming, NULL);
   }
   browser_sort (state);
   return 0;
@@ -863,6 +1037,8 @@ static void folder_entry (char *s, size_t slen, MUTTMENU *menu, int num)
 
   folder.ff = &((struct folder_file *) menu->data)[num];
   folder.num = num;
+  if (folder.ff->stat_pending)
+    browser_stat (folder.ff);
   
 #ifdef USE_NNTP
   if (option (OPTNEWS))
@@ -47,6 +47,7 @@ struct folder_file
   unsigned inferiors : 1;
 #endif
   unsigned has_buffy : 1;
+  unsigned stat_pending : 1;	/* mode only has the file type so far */
 #ifdef USE_NNTP
   NNTP_DATA *nd;
 #endif
@@ -591,6 +591,40 @@ char *fgetconvs (char *buf, size_t l, FGETCONV *_fc)
     return NULL;
 }
 
+/*
+ * Read up to l converted bytes into buf.  This is the block version of
+ * fgetconv(): without a conversion it is a plain fread().
+ * Returns the number of bytes read, 0 at end of file.
+ */
+size_t fgetconvbuf (char *buf, size_t l, FGETCONV *_fc)
+{
+  struct fgetconv_s *fc = (struct fgetconv_s *)_fc;
+  size_t r = 0, n;
+  int c;
+
+  if (!fc)
+    return 0;
+  if (fc->cd == (iconv_t)-1)
+    return fread (buf, 1, l, fc->file);
+
+  while (r < l)
+  {
+    if (fc->p && fc->p < fc->ob)
+    {
+      n = MIN (l - r, (size_t) (fc->ob - fc->p));
+      memcpy (buf + r, fc->p, n);
+      fc->p += n;
+      r += n;
+    }
+    else if ((c = fgetconv (_fc)) != EOF)
+      buf[r++] = (char) c;
+    else
+      break;
+  }
+
+  return r;
+}
+
 int fgetconv (FGETCONV *_fc)
 {
   struct fgetconv_s *fc = (struct fgetconv_s *)_fc;
@@ -44,6 +44,7 @@ typedef void * FGETCONV;
 FGETCONV *fgetconv_open (FILE *, const char *, const char *, int);
 int fgetconv (FGETCONV *);
 char * fgetconvs (char *, size_t, FGETCONV *);
+size_t fgetconvbuf (char *, size_t, FGETCONV *);
 void fgetconv_close (FGETCONV **);
 
 void mutt_set_langinfo_charset (void);
@@ -349,6 +349,8 @@ mutt_copy_hdr (FILE *in, FILE *out, LOFF_T off_start, LOFF_T off_end, int flags,
 	CH_UPDATE_IRT	update the In-Reply-To: header
 	CH_UPDATE_REFS	update the References: header
 	CH_VIRTUAL      write virtual header lines too
+	CH_PAD_STATUS	always write Status: and X-Status:, padded so
+			that any flags fit when rewritten in place
 
    prefix
    	string to use if CH_PREFIX is set
@@ -399,23 +401,29 @@ mutt_copy_header (FILE *in, HEADER *h, FILE *out, int flags, const char *prefix)
 
   if ((flags & CH_UPDATE) && (flags & CH_NOSTATUS) == 0)
   {
-    if (h->old || h->read)
+    if (h->old || h->read || (flags & CH_PAD_STATUS))
     {
       fputs ("Status: ", out);
       if (h->read)
 	fputs ("RO", out);
       else if (h->old)
-	fputc ('O', out);
+	fputs ((flags & CH_PAD_STATUS) ? "O " : "O", out);
+      else
+	fputs ("  ", out);
       fputc ('\n', out);
     }
 
-    if (h->flagged || h->replied)
+    if (h->flagged || h->replied || (flags & CH_PAD_STATUS))
     {
       fputs ("X-Status: ", out);
       if (h->replied)
 	fputc ('A', out);
+      else if (flags & CH_PAD_STATUS)
+	fputc (' ', out);
       if (h->flagged)
 	fputc ('F', out);
+      else if (flags & CH_PAD_STATUS)
+	fputc (' ', out);
       fputc ('\n', out);
     }
   }
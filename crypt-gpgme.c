@@ -119,8 +119,24 @@ typedef struct crypt_entry
   crypt_key_t *key;
 } crypt_entry_t;
 
+/* Opportunistic encryption looks for the keys of all recipients each
+   time they are edited in the compose menu.  The keys found (or not
+   found) are remembered for this long, unless the keyrings change. */
+#define CRYPT_KEYCACHE_TTL 300
+
+struct crypt_keycache
+{
+  char *addr;           /* mailbox and personal name looked up */
+  unsigned int app;
+  crypt_key_t *key;     /* NULL if there is no usable key */
+  time_t added;
+  struct crypt_keycache *next;
+};
+
 
 static struct crypt_cache *id_defaults = NULL;
+static struct crypt_keycache *key_cache = NULL;
+static char *key_cache_stamp = NULL;
 static gpgme_key_t signature_key = NULL;
 static char *current_sender = NULL;
 
@@ -4143,9 +4159,119 @@ static crypt_key_t *crypt_select_key (crypt_key_t *keys,
   return k;
 }
 
+static void crypt_keycache_free (struct crypt_keycache **cp)
+{
+  FREE (&(*cp)->addr);
+  crypt_free_key (&(*cp)->key);
+  FREE (cp);		/* __FREE_CHECKED__ */
+}
+
+/* Forget the cached keys when the keyrings have changed since they
+   were looked up. */
+static void crypt_keycache_check (void)
+{
+  struct crypt_keycache *c;
+  char *stamp = crypt_keyring_stamp ();
+
+  if (key_cache && stamp && !mutt_strcmp (stamp, key_cache_stamp))
+    {
+      FREE (&stamp);
+      return;
+    }
+
+  while (key_cache)
+    {
+      c = key_cache;
+      key_cache = c->next;
+      crypt_keycache_free (&c);
+    }
+
+  FREE (&key_cache_stamp);
+  key_cache_stamp = stamp;
+}
+
+static struct crypt_keycache *crypt_keycache_find (ADDRESS *a,
+                                                   unsigned int app)
+{
+  struct crypt_keycache *c;
+  char *addr = NULL;
+  time_t now = time (NULL);
+
+  safe_asprintf (&addr, "%s\n%s", NONULL (a->mailbox), NONULL (a->personal));
+  for (c = key_cache; c; c = c->next)
+    if (c->app == app && now - c->added < CRYPT_KEYCACHE_TTL
+        && !strcmp (c->addr, addr))
+      break;
+  FREE (&addr);
+
+  return c;
+}
+
+static void crypt_keycache_add (ADDRESS *a, unsigned int app, crypt_key_t *k)
+{
+  struct crypt_keycache *c, **cp;
+  char *addr = NULL;
+
+  /* without a stamp there is no telling when the keys go stale */
+  if (!key_cache_stamp)
+    return;
+
+  safe_asprintf (&addr, "%s\n%s", NONULL (a->mailbox), NONULL (a->personal));
+
+  /* drop the expired entry, if any */
+  for (cp = &key_cache; *cp; cp = &(*cp)->next)
+    if ((*cp)->app == app && !strcmp ((*cp)->addr, addr))
+      {
+        c = *cp;
+        *cp = c->next;
+        crypt_keycache_free (&c);
+        break;
+      }
+
+  c = safe_calloc (1, sizeof (struct crypt_keycache));
+  c->addr = addr;
+  c->app = app;
+  c->key = k ? crypt_copy_key (k) : NULL;
+  c->added = time (NULL);
+  c->next = key_cache;
+  key_cache = c;
+}
+
+/* Look for the keys of all the recipients of ADRLIST not in the key cache
+   with a single keylist operation, for crypt_getkeybyaddr() to choose
+   from. */
+static crypt_key_t *get_oppenc_candidates (ADDRESS *adrlist, unsigned int app)
+{
+  LIST *hints = NULL;
+  crypt_key_t *keys;
+  ADDRESS *p;
+
+  for (p = adrlist; p; p = p->next)
+    {
+      if (crypt_keycache_find (p, app))
+        continue;
+      if (p->mailbox)
+        hints = crypt_add_string_to_hints (hints, p->mailbox);
+      if (p->personal)
+        hints = crypt_add_string_to_hints (hints, p->personal);
+    }
+
+  if (!hints)
+    return NULL;
+
+  keys = get_candidates (hints, app, 0);
+  mutt_free_list (&hints);
+
+  return keys;
+}
+
+/* Find the key for address A.  In oppenc_mode, the result is taken from
+   and added to the key cache, and the keys are chosen from *CANDIDATES
+   instead of listing them, unless CANDIDATES is NULL. */
 static crypt_key_t *crypt_getkeybyaddr (ADDRESS * a, short abilities,
 					unsigned int app, int *forced_valid,
-					int oppenc_mode)
+					int oppenc_mode,
+					crypt_key_t **candidates)
 {
   ADDRESS *r, *p;
   LIST *hints = NULL;
@@ -4168,19 +4294,37 @@ static crypt_key_t *crypt_getkeybyaddr (ADDRESS * a, short abilities,
   
   *forced_valid = 0;
 
-  if (a && a->mailbox)
-    hints = crypt_add_string_to_hints (hints, a->mailbox);
-  if (a && a->personal)
-    hints = crypt_add_string_to_hints (hints, a->personal);
+  if (oppenc_mode)
+    {
+      struct crypt_keycache *c = crypt_keycache_find (a, app);
 
-  if (! oppenc_mode )
-    mutt_message (_("Looking for keys matching \"%s\"..."), a->mailbox);
-  keys = get_candidates (hints, app, (abilities & KEYFLAG_CANSIGN) );
+      if (c)
+        return c->key ? crypt_copy_key (c->key) : NULL;
+    }
+
+  if (oppenc_mode && candidates)
+    keys = *candidates;
+  else
+    {
+      if (a && a->mailbox)
+        hints = crypt_add_string_to_hints (hints, a->mailbox);
+      if (a && a->personal)
+        hints = crypt_add_string_to_hints (hints, a->personal);
+
+      if (! oppenc_mode )
+        mutt_message (_("Looking for keys matching \"%s\"..."), a->mailbox);
+      keys = get_candidates (hints, app, (abilities & KEYFLAG_CANSIGN) );
+
+      mutt_free_list (&hints);
+      candidates = NULL;
+    }
 
-  mutt_free_list (&hints);
-  
   if (!keys)
-    return NULL;
+    {
+      if (oppenc_mode)
+        crypt_keycache_add (a, app, NULL);
+      return NULL;
+    }
   
   dprint (5, (debugfile, "crypt_getkeybyaddr: looking for %s <%s>.",
 	      a->personal, a->mailbox));
@@ -4256,7 +4400,9 @@ static crypt_key_t *crypt_getkeybyaddr (ADDRESS * a, short abilities,
         }
     }
   
-  crypt_free_key (&keys);
+  /* the candidates are shared with the other recipients */
+  if (!candidates)
+    crypt_free_key (&keys);
   
   if (matches)
     {
@@ -4293,6 +4439,9 @@ static crypt_key_t *crypt_getkeybyaddr (ADDRESS * a, short abilities,
     }
   else 
     k = NULL;
+
+  if (oppenc_mode)
+    crypt_keycache_add (a, app, k);
   
   return k;
 }
@@ -4442,11 +4591,18 @@ static char *find_keys (ADDRESS *adrlist, unsigned int app, int oppenc_mode)
   int forced_valid;
   int r;
   int key_selected;
+  crypt_key_t *candidates = NULL;
 
 #if 0
   *r_application = APPLICATION_PGP|APPLICATION_SMIME;
 #endif
 
+  if (oppenc_mode)
+    {
+      crypt_keycache_check ();
+      candidates = get_oppenc_candidates (adrlist, app);
+    }
+
   for (p = adrlist; p ; p = p->next)
     {
       key_selected = 0;
@@ -4509,14 +4665,17 @@ static char *find_keys (ADDRESS *adrlist, unsigned int app, int oppenc_mode)
                 FREE (&keylist);
                 rfc822_free_address (&addr);
                 mutt_free_list (&crypt_hook_list);
+                crypt_free_key (&candidates);
                 return NULL;
               }
           }
 
         if (k_info == NULL)
           {
+            /* the addresses of crypt-hooks are not among the candidates */
             k_info = crypt_getkeybyaddr (q, KEYFLAG_CANENCRYPT,
-                                        app, &forced_valid, oppenc_mode);
+                                        app, &forced_valid, oppenc_mode,
+                                        q == p ? &candidates : NULL);
           }
 
         if ((k_info == NULL) && (! oppenc_mode))
@@ -4538,6 +4697,7 @@ static char *find_keys (ADDRESS *adrlist, unsigned int app, int oppenc_mode)
             FREE (&keylist);
             rfc822_free_address (&addr);
             mutt_free_list (&crypt_hook_list);
+            crypt_free_key (&candidates);
             return NULL;
           }
 
@@ -4571,6 +4731,7 @@ static char *find_keys (ADDRESS *adrlist, unsigned int app, int oppenc_mode)
 
       mutt_free_list (&crypt_hook_list);
     }
+  crypt_free_key (&candidates);
   return (keylist);
 }
 
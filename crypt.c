@@ -1141,3 +1141,42 @@ short crypt_is_numerical_keyid (const char *s)
 }
 
 
+/*
+ * Describes the state of the GnuPG keyring and trust files, so that
+ * cached key listings can tell when they have gone stale.  Returns a
+ * string to be FREE'd by the caller, or NULL if none of the files exist.
+ */
+
+char *crypt_keyring_stamp (void)
+{
+  static const char *files[] =
+  {
+    "pubring.kbx", "pubring.gpg", "secring.gpg", "trustdb.gpg",
+    "private-keys-v1.d", "trustlist.txt", NULL
+  };
+  char home[_POSIX_PATH_MAX], path[_POSIX_PATH_MAX];
+  char buf[STRING], *stamp = NULL;
+  const char *p;
+  struct stat st;
+  size_t len;
+  int i;
+
+  if ((p = getenv ("GNUPGHOME")))
+    strfcpy (home, p, sizeof (home));
+  else
+    mutt_concat_path (home, NONULL (Homedir), ".gnupg", sizeof (home));
+
+  for (i = 0; files[i]; i++)
+  {
+    mutt_concat_path (path, home, files[i], sizeof (path));
+    if (stat (path, &st) == -1)
+      continue;
+    snprintf (buf, sizeof (buf), "%s %ld %ld\n", files[i],
+	      (long) st.st_mtime, (long) st.st_size);
+    len = mutt_strlen (stamp);
+    safe_realloc (&stamp, len + mutt_strlen (buf) + 1);
+    strcpy (stamp + len, buf);	/* __STRCPY_CHECKED__ */
+  }
+
+  return stamp;
+}
@@ -38,6 +38,9 @@
 #ifdef HAVE_SYS_TIME_H
 # include <sys/time.h>
 #endif
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
 #include <time.h>
 
 #ifdef HAVE_LANGINFO_YESEXPR
@@ -905,6 +908,38 @@ void mutt_flush_macro_to_endcond (void)
   }
 }
 
+/* Return 1 if a key is waiting to be read, without blocking.  Used to
+ * do work in the background while the user isn't typing. */
+int mutt_input_pending (void)
+{
+  fd_set rfds;
+  struct timeval tv = { 0, 0 };
+  int ch;
+
+  if (UngetCount || (!option (OPTIGNOREMACROEVENTS) && MacroBufferCount) ||
+      SigWinch)
+    return 1;
+
+  /* curses may already have read a key off the terminal, where select()
+   * can't see it */
+  if (!option (OPTNOCURSES))
+  {
+    timeout (0);
+    ch = getch ();
+    timeout (-1); /* restore blocking operation */
+    if (ch != ERR)
+    {
+      ungetch (ch);
+      return 1;
+    }
+  }
+
+  FD_ZERO (&rfds);
+  FD_SET (0, &rfds);
+
+  return select (1, &rfds, NULL, NULL, &tv) != 0;
+}
+
 void mutt_flushinp (void)
 {
   UngetCount = 0;
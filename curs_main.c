@@ -29,6 +29,7 @@
 #include "sort.h"
 #include "buffy.h"
 #include "mx.h"
+#include "stats.h"
 
 #ifdef USE_SIDEBAR
 #include "sidebar.h"
@@ -986,9 +987,24 @@ int mutt_index_menu (void)
       {
 	menu_check_recenter (menu);
 
+#ifdef USE_IMAP
+	/* fill in the envelopes of this page and the next before drawing */
+	if (Context->magic == MUTT_IMAP &&
+	    (menu->redraw & (REDRAW_INDEX | REDRAW_MOTION |
+			     REDRAW_MOTION_RESYNCH | REDRAW_CURRENT)))
+	{
+	  if (imap_fetch_virtual_envelopes (Context, menu->top,
+					    menu->top + 2 * menu->pagelen - 1) > 0)
+	    menu->redraw |= REDRAW_INDEX;
+	}
+#endif
+
 	if (menu->redraw & REDRAW_INDEX)
 	{
+	  stat_time_t t = mutt_stats_now ();
+
 	  menu_redraw_index (menu);
+	  mutt_stats_add (STAT_INDEX_REDRAW, t);
 	  menu->redraw |= REDRAW_STATUS;
 	}
 	else if (menu->redraw & (REDRAW_MOTION_RESYNCH | REDRAW_MOTION))
@@ -223,6 +223,7 @@ WHERE unsigned short Counter INITVAL (0);
 #ifdef USE_NNTP
 WHERE short NewsPollTimeout;
 WHERE short NntpContext;
+WHERE short NntpPipelineDepth;
 #endif
 
 WHERE short ConnectTimeout;
@@ -253,8 +254,12 @@ WHERE int SidebarNeedsRedraw INITVAL (0);
 #endif
 
 #ifdef USE_IMAP
+WHERE short ImapFetchConnections;
 WHERE short ImapKeepalive;
+WHERE short ImapLazyHeaders;
 WHERE short ImapPipelineDepth;
+WHERE short ImapPrefetch;
+WHERE short ImapPrefetchMaxSize;
 #endif
 
 /* flags for received signals */
@@ -381,7 +381,7 @@ bail:
   return NULL;
 }
 
-pgp_key_t pgp_get_candidates (pgp_ring_t keyring, LIST * hints)
+static pgp_key_t pgp_read_keyring (pgp_ring_t keyring, LIST * hints)
 {
   FILE *fp;
   pid_t thepid;
@@ -443,3 +443,118 @@ pgp_key_t pgp_get_candidates (pgp_ring_t keyring, LIST * hints)
   return db;
 }
 
+
+/*
+ * Every key lookup used to run the list command with the lookup's hints.
+ * Instead, the whole keyring is listed once and kept here, and lookups
+ * get copies of the keys matching their hints.  The index is rebuilt
+ * when one of the GnuPG keyring or trust database files changes, or
+ * when the list command, $charset or $pgp_ignore_subkeys do.  Without
+ * any of these files (e.g. with a lister for another PGP), there is no
+ * telling when the index gets stale, so the list command is run for
+ * every lookup as before.
+ */
+
+static struct
+{
+  pgp_key_t keys;
+  char *stamp;
+} KeyringIndex[2];
+
+/* describes the state of the keyring files and of the settings the
+ * index depends on, returns NULL if no keyring file can be found */
+static char *pgp_keyring_stamp (pgp_ring_t keyring)
+{
+  char buf[LONG_STRING], *files, *stamp = NULL;
+
+  if (!(files = crypt_keyring_stamp ()))
+    return NULL;
+
+  snprintf (buf, sizeof (buf), "%s\n%s\n%d\n",
+	    keyring == PGP_SECRING ? NONULL (PgpListSecringCommand) :
+				     NONULL (PgpListPubringCommand),
+	    NONULL (Charset), option (OPTPGPIGNORESUB) ? 1 : 0);
+  safe_asprintf (&stamp, "%s%s", buf, files);
+  FREE (&files);
+
+  return stamp;
+}
+
+/* does any of the hints match the key or one of its subkeys, the way
+ * the list command would select them? */
+static int pgp_key_matches_hints (pgp_key_t k, LIST *hints)
+{
+  pgp_key_t s;
+  pgp_uid_t *a;
+  LIST *h;
+
+  if (!hints)
+    return 1;
+
+  for (h = hints; h; h = h->next)
+  {
+    for (a = k->address; a; a = a->next)
+      if (mutt_stristr (a->addr, h->data))
+	return 1;
+    for (s = k; s && (s == k || s->parent == k); s = s->next)
+      if (mutt_stristr (s->keyid, h->data) ||
+	  mutt_stristr (s->fingerprint, h->data))
+	return 1;
+  }
+
+  return 0;
+}
+
+static pgp_key_t pgp_copy_key (pgp_key_t k, pgp_key_t parent)
+{
+  pgp_key_t c = pgp_new_keyinfo ();
+
+  c->keyid = safe_strdup (k->keyid);
+  c->fingerprint = safe_strdup (k->fingerprint);
+  c->address = pgp_copy_uids (k->address, c);
+  c->flags = k->flags;
+  c->keylen = k->keylen;
+  c->gen_time = k->gen_time;
+  c->numalg = k->numalg;
+  c->algorithm = k->algorithm;
+  c->parent = parent;
+
+  return c;
+}
+
+pgp_key_t pgp_get_candidates (pgp_ring_t keyring, LIST * hints)
+{
+  pgp_key_t db = NULL, *kend = &db, k, mainkey = NULL;
+  char *stamp;
+  int idx = keyring == PGP_SECRING ? 1 : 0;
+  int take = 0;
+
+  if (!(stamp = pgp_keyring_stamp (keyring)))
+    return pgp_read_keyring (keyring, hints);
+
+  if (!KeyringIndex[idx].stamp || strcmp (stamp, KeyringIndex[idx].stamp))
+  {
+    dprint (2, (debugfile, "pgp_get_candidates: reading %s keyring\n",
+		idx ? "secret" : "public"));
+    pgp_free_key (&KeyringIndex[idx].keys);
+    KeyringIndex[idx].keys = pgp_read_keyring (keyring, NULL);
+    mutt_str_replace (&KeyringIndex[idx].stamp, stamp);
+  }
+  FREE (&stamp);
+
+  for (k = KeyringIndex[idx].keys; k; k = k->next)
+  {
+    if (!(k->flags & KEYFLAG_SUBKEY))
+      take = pgp_key_matches_hints (k, hints);
+    if (!take)
+      continue;
+
+    if (!(k->flags & KEYFLAG_SUBKEY))
+      mainkey = *kend = pgp_copy_key (k, NULL);
+    else
+      *kend = pgp_copy_key (k, mainkey);
+    kend = &(*kend)->next;
+  }
+
+  return db;
+}
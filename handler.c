@@ -39,6 +39,7 @@
 
 #define BUFI_SIZE 1000
 #define BUFO_SIZE 2000
+#define BUFR_SIZE 8192
 
 
 typedef int (*handler_t) (BODY *, STATE *);
@@ -150,16 +151,16 @@ static void mutt_decode_xbit (STATE *s, long len, int istext, iconv_t cd)
     mutt_copy_bytes (s->fpin, s->fpout, len);
 }
 
-static int qp_decode_triple (char *s, char *d)
+static int qp_decode_triple (const char *s, const char *end, char *d)
 {
   /* soft line break */
-  if (*s == '=' && !(*(s+1)))
+  if (*s == '=' && s + 1 == end)
     return 1;
   
   /* quoted-printable triple */
-  if (*s == '=' &&
-      isxdigit ((unsigned char) *(s+1)) &&
-      isxdigit ((unsigned char) *(s+2)))
+  if (*s == '=' && s + 2 < end &&
+      !((*(s+1) | *(s+2)) & 0x80) &&
+      (hexval (*(s+1)) | hexval (*(s+2))) >= 0)
   {
     *d = (hexval (*(s+1)) << 4) | hexval (*(s+2));
     return 0;
@@ -169,10 +170,11 @@ static int qp_decode_triple (char *s, char *d)
   return -1;
 }
 
-static void qp_decode_line (char *dest, char *src, size_t *l,
-			    int last)
+static void qp_decode_line (char *dest, const char *src, size_t srclen,
+			    size_t *l, int last)
 {
-  char *d, *s;
+  char *d;
+  const char *s, *end = src + srclen, *eq;
   char c = 0;
 
   int kind = -1;
@@ -180,9 +182,21 @@ static void qp_decode_line (char *dest, char *src, size_t *l,
 
   /* decode the line */
   
-  for (d = dest, s = src; *s;)
+  for (d = dest, s = src; s < end;)
   {
-    switch ((kind = qp_decode_triple (s, &c)))
+    if (*s != '=')
+    {
+      /* copy the run of literal characters up to the next '=' at once */
+      if ((eq = memchr (s, '=', end - s)) == NULL)
+	eq = end;
+      memcpy (d, s, eq - s);
+      d += eq - s;
+      s = eq;
+      kind = -1;
+      continue;
+    }
+
+    switch ((kind = qp_decode_triple (s, end, &c)))
     {
       case  0: *d++ = c; s += 3; break;	/* qp triple */
       case -1: *d++ = *s++;      break; /* single character */
@@ -205,6 +219,60 @@ static void qp_decode_line (char *dest, char *src, size_t *l,
   *l = d - dest;
 }
 
+/*
+ * Block reader for the decoders below.  The input is read in chunks
+ * of BUFR_SIZE bytes instead of one fgetc()/fgets() call at a time,
+ * which makes decoding large attachments much cheaper.  Whatever was
+ * read ahead but not consumed is handed back with fseeko() by
+ * dec_reader_done(), so the stream ends up exactly where the old
+ * character-at-a-time decoders left it.
+ */
+
+struct dec_reader
+{
+  FILE *fp;
+  char buf[BUFR_SIZE];
+  size_t pos;		/* first unconsumed byte in buf */
+  size_t end;		/* end of valid data in buf */
+};
+
+static void dec_reader_init (struct dec_reader *r, FILE *fp)
+{
+  r->fp = fp;
+  r->pos = r->end = 0;
+}
+
+/* Make at least `want' (<= BUFR_SIZE) contiguous bytes available at
+ * r->buf + r->pos, unless the end of the file comes first.
+ * Returns the number of bytes available. */
+static size_t dec_reader_fill (struct dec_reader *r, size_t want)
+{
+  size_t n;
+
+  if (r->end - r->pos >= want)
+    return r->end - r->pos;
+
+  if (r->pos)
+  {
+    memmove (r->buf, r->buf + r->pos, r->end - r->pos);
+    r->end -= r->pos;
+    r->pos = 0;
+  }
+
+  while (r->end < want &&
+	 (n = fread (r->buf + r->end, 1, sizeof (r->buf) - r->end, r->fp)) > 0)
+    r->end += n;
+
+  return r->end - r->pos;
+}
+
+static void dec_reader_done (struct dec_reader *r)
+{
+  if (r->end > r->pos)
+    fseeko (r->fp, -(LOFF_T) (r->end - r->pos), SEEK_CUR);
+  r->pos = r->end = 0;
+}
+
 /* 
  * Decode an attachment encoded with quoted-printable.
  * 
@@ -213,27 +281,25 @@ static void qp_decode_line (char *dest, char *src, size_t *l,
  * quoted-printable.  That means that we always can store the
  * result in a buffer of at most the _same_ size.
  * 
- * Now, we don't special-case if the line we read with fgets()
- * isn't terminated.  We don't care about this, since STRING > 78,
- * so corrupted input will just be corrupted a bit more.  That
- * implies that STRING+1 bytes are always sufficient to store the
- * result of qp_decode_line.
+ * Now, we don't special-case if the line we read isn't terminated.
+ * We don't care about this, since STRING > 78, so corrupted input
+ * will just be corrupted a bit more.  That implies that STRING+1
+ * bytes are always sufficient to store the result of qp_decode_line.
  * 
- * Finally, at soft line breaks, some part of a multibyte character
- * may have been left over by mutt_convert_to_state().  This shouldn't
- * be more than 6 characters, so STRING + 7 should be sufficient
- * memory to store the decoded data.
- * 
- * Just to make sure that I didn't make some off-by-one error
- * above, we just use STRING*2 for the target buffer's size.
+ * Decoded lines are collected in `decline' and only handed to
+ * mutt_convert_to_state() once less than STRING*2 bytes are left, so
+ * there is always room for one more line plus the part of a multibyte
+ * character that may have been left over by mutt_convert_to_state().
  * 
  */
 
 static void mutt_decode_quoted (STATE *s, long len, int istext, iconv_t cd)
 {
-  char line[STRING];
-  char decline[2*STRING];
+  struct dec_reader r;
+  char decline[BUFR_SIZE];
+  char *line, *p;
   size_t l = 0;
+  size_t n;
   size_t linelen;      /* number of input bytes in `line' */
   size_t l3;
   
@@ -242,21 +308,28 @@ static void mutt_decode_quoted (STATE *s, long len, int istext, iconv_t cd)
   if (istext)
     state_set_prefix(s);
 
+  dec_reader_init (&r, s->fpin);
+
   while (len > 0)
   {
-    last = 0;
-    
     /*
-     * It's ok to use a fixed size buffer for input, even if the line turns
-     * out to be longer than this.  Just process the line in chunks.  This
-     * really shouldn't happen according the MIME spec, since Q-P encoded
-     * lines are at most 76 characters, but we should be liberal about what
-     * we accept.
+     * Lines are handled in pieces of at most STRING - 1 bytes, exactly
+     * like the fgets() into a STRING sized buffer this replaces.  Q-P
+     * encoded lines are at most 76 characters according to the MIME
+     * spec, but we should be liberal about what we accept, and keeping
+     * the same split points keeps the output identical for broken input.
      */
-    if (fgets (line, MIN ((ssize_t)sizeof (line), len + 1), s->fpin) == NULL)
+    n = MIN ((size_t) STRING - 1, (size_t) len);
+    if ((n = MIN (n, dec_reader_fill (&r, n))) == 0)
       break;
 
-    linelen = strlen(line);
+    line = r.buf + r.pos;
+    if ((p = memchr (line, '\n', n)) != NULL)
+      n = p - line + 1;
+    r.pos += n;
+
+    /* like strlen() on the fgets() result, stop at an embedded NUL */
+    linelen = (p = memchr (line, '\0', n)) != NULL ? (size_t) (p - line) : n;
     len -= linelen;
 
     /*
@@ -270,94 +343,138 @@ static void mutt_decode_quoted (STATE *s, long len, int istext, iconv_t cd)
     {
       while (linelen > 0 && ISSPACE (line[linelen-1]))
        linelen--;
-      line[linelen]=0;
     }
 
     /* decode and do character set conversion */
-    qp_decode_line (decline + l, line, &l3, last);
+    qp_decode_line (decline + l, line, linelen, &l3, last);
     l += l3;
-    mutt_convert_to_state (cd, decline, &l, s);
+    if (l + 2*STRING > sizeof (decline))
+      mutt_convert_to_state (cd, decline, &l, s);
   }
 
+  dec_reader_done (&r);
+
+  mutt_convert_to_state (cd, decline, &l, s);
   mutt_convert_to_state (cd, 0, 0, s);
   state_reset_prefix(s);
 }
 
-void mutt_decode_base64 (STATE *s, long len, int istext, iconv_t cd)
+/* Append a decoded byte to bufi, turning CRLF into LF for text parts. */
+static void b64_putc (int ch, int istext, int *cr, char *bufi, size_t *l)
 {
-  char buf[5];
-  int c1, c2, c3, c4, ch, cr = 0, i;
-  char bufi[BUFI_SIZE];
-  size_t l = 0;
+  if (*cr && ch != '\n')
+    bufi[(*l)++] = '\r';
+
+  *cr = 0;
 
-  buf[4] = 0;
+  if (istext && ch == '\r')
+    *cr = 1;
+  else
+    bufi[(*l)++] = ch;
+}
+
+void mutt_decode_base64 (STATE *s, long len, int istext, iconv_t cd)
+{
+  struct dec_reader r;
+  char buf[4];
+  const unsigned char *p, *end;
+  int c1, c2, c3, c4, ch, cr = 0, i = 0, done = 0;
+  unsigned long v;
+  char bufi[BUFR_SIZE];
+  size_t l = 0, avail;
 
   if (istext) 
     state_set_prefix(s);
 
-  while (len > 0)
+  dec_reader_init (&r, s->fpin);
+
+  while (len > 0 && !done)
   {
-    for (i = 0 ; i < 4 && len > 0 ; len--)
-    {
-      if ((ch = fgetc (s->fpin)) == EOF)
-	break;
-      if (ch >= 0 && ch < 128 && (base64val(ch) != -1 || ch == '='))
-	buf[i++] = ch;
-    }
-    if (i != 4)
-    {
-      /* "i" may be zero if there is trailing whitespace, which is not an error */
-      if (i != 0)
-	dprint (2, (debugfile, "%s:%d [mutt_decode_base64()]: "
-	      "didn't get a multiple of 4 chars.\n", __FILE__, __LINE__));
+    if ((avail = dec_reader_fill (&r, 1)) == 0)
       break;
-    }
-
-    c1 = base64val (buf[0]);
-    c2 = base64val (buf[1]);
-    ch = (c1 << 2) | (c2 >> 4);
+    p = (const unsigned char *) r.buf + r.pos;
+    end = p + MIN (avail, (size_t) len);
 
-    if (cr && ch != '\n') 
-      bufi[l++] = '\r';
+    while (p < end && !done)
+    {
+      /*
+       * Fast path: four base64 digits in a row decode to three bytes
+       * with a single validity check.  '=' and anything that has to
+       * be skipped (line breaks, garbage) go through the slow path,
+       * which collects digits one at a time.
+       */
+      if (i == 0 && end - p >= 4 && !((p[0] | p[1] | p[2] | p[3]) & 0x80))
+      {
+	c1 = base64val (p[0]);
+	c2 = base64val (p[1]);
+	c3 = base64val (p[2]);
+	c4 = base64val (p[3]);
+	if ((c1 | c2 | c3 | c4) >= 0)
+	{
+	  v = ((unsigned long) c1 << 18) | (c2 << 12) | (c3 << 6) | c4;
+	  p += 4;
+	  if (istext)
+	  {
+	    b64_putc ((v >> 16) & 0xff, istext, &cr, bufi, &l);
+	    b64_putc ((v >> 8) & 0xff, istext, &cr, bufi, &l);
+	    b64_putc (v & 0xff, istext, &cr, bufi, &l);
+	  }
+	  else
+	  {
+	    bufi[l++] = (v >> 16) & 0xff;
+	    bufi[l++] = (v >> 8) & 0xff;
+	    bufi[l++] = v & 0xff;
+	  }
+	  if (l + 8 >= sizeof (bufi))
+	    mutt_convert_to_state (cd, bufi, &l, s);
+	  continue;
+	}
+      }
 
-    cr = 0;
-      
-    if (istext && ch == '\r')
-      cr = 1;
-    else
-      bufi[l++] = ch;
+      ch = *p++;
+      if (ch < 128 && (base64val(ch) != -1 || ch == '='))
+	buf[i++] = ch;
+      if (i < 4)
+	continue;
+      i = 0;
 
-    if (buf[2] == '=')
-      break;
-    c3 = base64val (buf[2]);
-    ch = ((c2 & 0xf) << 4) | (c3 >> 2);
+      c1 = base64val (buf[0]);
+      c2 = base64val (buf[1]);
+      ch = (c1 << 2) | (c2 >> 4);
+      b64_putc (ch, istext, &cr, bufi, &l);
 
-    if (cr && ch != '\n')
-      bufi[l++] = '\r';
+      if (buf[2] == '=')
+      {
+	done = 1;
+	break;
+      }
+      c3 = base64val (buf[2]);
+      ch = ((c2 & 0xf) << 4) | (c3 >> 2);
+      b64_putc (ch, istext, &cr, bufi, &l);
 
-    cr = 0;
+      if (buf[3] == '=')
+      {
+	done = 1;
+	break;
+      }
+      c4 = base64val (buf[3]);
+      ch = ((c3 & 0x3) << 6) | c4;
+      b64_putc (ch, istext, &cr, bufi, &l);
 
-    if (istext && ch == '\r')
-      cr = 1;
-    else
-      bufi[l++] = ch;
+      if (l + 8 >= sizeof (bufi))
+	mutt_convert_to_state (cd, bufi, &l, s);
+    }
 
-    if (buf[3] == '=') break;
-    c4 = base64val (buf[3]);
-    ch = ((c3 & 0x3) << 6) | c4;
+    len -= (const char *) p - (r.buf + r.pos);
+    r.pos = (const char *) p - r.buf;
+  }
 
-    if (cr && ch != '\n')
-      bufi[l++] = '\r';
-    cr = 0;
+  /* "i" may be zero if there is trailing whitespace, which is not an error */
+  if (!done && i != 0)
+    dprint (2, (debugfile, "%s:%d [mutt_decode_base64()]: "
+		"didn't get a multiple of 4 chars.\n", __FILE__, __LINE__));
 
-    if (istext && ch == '\r')
-      cr = 1;
-    else
-      bufi[l++] = ch;
-    
-    if (l + 8 >= sizeof (bufi))
-      mutt_convert_to_state (cd, bufi, &l, s);
-  }
+  dec_reader_done (&r);
 
   if (cr) bufi[l++] = '\r';
 
@@ -153,6 +153,13 @@ void *hash_find_hash (const HASH * table, int hash, const char *key)
   return NULL;
 }
 
+/* returns the chain of elements the key hashes to, for walking through
+ * the duplicates inserted with allow_dup */
+struct hash_elem *hash_find_bucket (const HASH * table, const char *key)
+{
+  return table->table[table->hash_string ((unsigned char *) key, table->nelem)];
+}
+
 void hash_set_data (HASH *table, const char *key, void *data)
 {
   if (!table)
@@ -34,6 +34,7 @@
 #include "hcache.h"
 #include "hcversion.h"
 #include "md5.h"
+#include "stats.h"
 
 static unsigned int hcachever = 0x0;
 
@@ -653,8 +654,9 @@ mutt_hcache_dump(header_cache_t *h, HEADER * header, int *off,
 #ifdef MIXMASTER
   nh.chain = NULL;
 #endif
-#if defined USE_POP || defined USE_IMAP
+#if defined USE_POP || defined USE_IMAP || defined USE_NOTMUCH
   nh.data = NULL;
+  nh.free_cb = NULL;
 #endif
 
   memcpy(d + *off, &nh, sizeof (HEADER));
@@ -673,6 +675,7 @@ mutt_hcache_restore(const unsigned char *d)
   int off = 0;
   HEADER *h = mutt_new_header();
   int convert = !Charset_is_utf8;
+  stat_time_t t = mutt_stats_now ();
 
   /* skip validate */
   off += sizeof (validate);
@@ -691,6 +694,7 @@ mutt_hcache_restore(const unsigned char *d)
 
   restore_char(&h->maildir_flags, d, &off, convert);
 
+  mutt_stats_add (STAT_HCACHE_RESTORE, t);
   return h;
 }
 
@@ -823,13 +827,19 @@ mutt_hcache_fetch_raw(header_cache_t *h, const char *key, size_t keylen)
 {
   char path[_POSIX_PATH_MAX];
   hcache_ops_t *ops = hcache_get_ops();
+  stat_time_t t;
+  void *data;
 
   if (!h || !ops)
     return NULL;
 
   keylen = snprintf(path, sizeof(path), "%s%s", h->folder, key);
 
-  return ops->fetch(h->ctx, path, keylen);
+  t = mutt_stats_now ();
+  data = ops->fetch(h->ctx, path, keylen);
+  mutt_stats_add (STAT_HCACHE_FETCH, t);
+
+  return data;
 }
 
 int
@@ -857,13 +867,19 @@ mutt_hcache_store_raw(header_cache_t *h, const char* key, size_t keylen,
 {
   char path[_POSIX_PATH_MAX];
   hcache_ops_t *ops = hcache_get_ops();
+  stat_time_t t;
+  int rc;
 
   if (!h || !ops)
     return -1;
 
   keylen = snprintf(path, sizeof(path), "%s%s", h->folder, key);
 
-  return ops->store(h->ctx, path, keylen, data, dlen);
+  t = mutt_stats_now ();
+  rc = ops->store(h->ctx, path, keylen, data, dlen);
+  mutt_stats_add (STAT_HCACHE_STORE, t);
+
+  return rc;
 }
 
 int
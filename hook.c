@@ -28,6 +28,11 @@
 #include "compress.h"
 #endif
 
+#ifdef USE_IMAP
+#include "mx.h"
+#include "imap/imap.h"
+#endif
+
 #include <limits.h>
 #include <string.h>
 #include <stdlib.h>
@@ -423,6 +428,10 @@ mutt_addr_hook (char *path, size_t pathlen, int type, CONTEXT *ctx, HEADER *hdr)
 void mutt_default_save (char *path, size_t pathlen, HEADER *hdr)
 {
   *path = 0;
+#ifdef USE_IMAP
+  /* the default is made from the envelope */
+  imap_fetch_envelope (Context, hdr);
+#endif
   if (mutt_addr_hook (path, pathlen, MUTT_SAVEHOOK, Context, hdr) != 0)
   {
     char tmp[_POSIX_PATH_MAX];
@@ -29,6 +29,7 @@
 #include "imap_private.h"
 #include "mx.h"
 #include "buffy.h"
+#include "stats.h"
 
 #include <ctype.h>
 #include <stdlib.h>
@@ -50,6 +51,7 @@ static void cmd_parse_lsub (IMAP_DATA* idata, char* s);
 static void cmd_parse_fetch (IMAP_DATA* idata, char* s);
 static void cmd_parse_myrights (IMAP_DATA* idata, const char* s);
 static void cmd_parse_search (IMAP_DATA* idata, const char* s);
+static void cmd_parse_sort (IMAP_DATA* idata, const char* s);
 static void cmd_parse_status (IMAP_DATA* idata, char* s);
 static void cmd_parse_enabled (IMAP_DATA* idata, const char* s);
 
@@ -67,6 +69,7 @@ static const char * const Capabilities[] = {
   "IDLE",
   "SASL-IR",
   "ENABLE",
+  "SORT",
 
   NULL
 };
@@ -178,6 +181,8 @@ int imap_cmd_step (IMAP_DATA* idata)
   else
   {
     dprint (3, (debugfile, "IMAP queue drained\n"));
+    if (idata->prefetch)
+      imap_prefetch_done (idata);
     imap_cmd_finish (idata);
   }
   
@@ -232,6 +237,7 @@ const char* imap_cmd_trailer (IMAP_DATA* idata)
 int imap_exec (IMAP_DATA* idata, const char* cmdstr, int flags)
 {
   int rc;
+  stat_time_t t = mutt_stats_now ();
 
   if ((rc = cmd_start (idata, cmdstr, flags)) < 0)
   {
@@ -248,6 +254,7 @@ int imap_exec (IMAP_DATA* idata, const char* cmdstr, int flags)
     rc = imap_cmd_step (idata);
   while (rc == IMAP_CMD_CONTINUE);
   mutt_allow_interrupt (0);
+  mutt_stats_add (STAT_IMAP_CMD, t);
 
   if (rc == IMAP_CMD_NO && (flags & IMAP_CMD_FAIL_OK))
     return -2;
@@ -465,6 +472,13 @@ static int cmd_handle_untagged (IMAP_DATA* idata)
   s = imap_next_word (idata->buf);
   pn = imap_next_word (s);
 
+  /* bodies of prefetches still in flight have to be consumed whatever
+   * state the connection has moved on to */
+  if (idata->prefetch && isdigit ((unsigned char) *s) &&
+      !ascii_strncasecmp ("FETCH", pn, 5) &&
+      imap_prefetch_parse (idata, atoi (s), pn))
+    return 0;
+
   if ((idata->state >= IMAP_SELECTED) && isdigit ((unsigned char) *s))
   {
     pn = s;
@@ -525,6 +539,8 @@ static int cmd_handle_untagged (IMAP_DATA* idata)
     cmd_parse_myrights (idata, s);
   else if (ascii_strncasecmp ("SEARCH", s, 6) == 0)
     cmd_parse_search (idata, s);
+  else if (ascii_strncasecmp ("SORT", s, 4) == 0)
+    cmd_parse_sort (idata, s);
   else if (ascii_strncasecmp ("STATUS", s, 6) == 0)
     cmd_parse_status (idata, s);
   else if (ascii_strncasecmp ("ENABLED", s, 7) == 0)
@@ -891,6 +907,29 @@ static void cmd_parse_search (IMAP_DATA* idata, const char* s)
   }
 }
 
+/* cmd_parse_sort: collect the UIDs of a SORT response for
+ *   imap_sort_headers */
+static void cmd_parse_sort (IMAP_DATA* idata, const char* s)
+{
+  IMAP_SORT* sort;
+
+  dprint (2, (debugfile, "Handling SORT\n"));
+
+  if (!idata->cmddata || idata->cmdtype != IMAP_CT_SORT)
+    return;
+  sort = (IMAP_SORT*) idata->cmddata;
+
+  while ((s = imap_next_word ((char*)s)) && *s != '\0')
+  {
+    if (sort->count == sort->max)
+    {
+      sort->max += 1024;
+      safe_realloc (&sort->uids, sort->max * sizeof (unsigned int));
+    }
+    sort->uids[sort->count++] = strtoul (s, NULL, 10);
+  }
+}
+
 /* first cut: just do buffy update. Later we may wish to cache all
  * mailbox information, even that not desired by buffy */
 static void cmd_parse_status (IMAP_DATA* idata, char* s)
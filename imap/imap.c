@@ -196,9 +196,73 @@ void imap_logout_all (void)
   }
 }
 
+/* imap_read_literal_buf: read bytes bytes from server into buf, appending
+ *   to whatever is there already. Like imap_read_literal, \r is stripped
+ *   from \r\n. */
+int imap_read_literal_buf (BUFFER* buf, IMAP_DATA* idata, long bytes)
+{
+  size_t offset = buf->dptr - buf->data;
+  long pos;
+  char c;
+  int r = 0;
+
+  dprint (2, (debugfile, "imap_read_literal_buf: reading %ld bytes\n", bytes));
+
+  /* the text can only shrink, so make room for all of it up front, but
+   * don't take the server's word for a huge literal */
+  if (offset + MIN (bytes, IMAP_LITERAL_PREALLOC) + 1 > buf->dsize)
+  {
+    buf->dsize = offset + MIN (bytes, IMAP_LITERAL_PREALLOC) + 1;
+    safe_realloc (&buf->data, buf->dsize);
+    buf->dptr = buf->data + offset;
+  }
+
+  for (pos = 0; pos < bytes; pos++)
+  {
+    /* room for a held back \r, this character and the final NUL */
+    if (buf->dptr + 3 > buf->data + buf->dsize)
+    {
+      offset = buf->dptr - buf->data;
+      buf->dsize *= 2;
+      safe_realloc (&buf->data, buf->dsize);
+      buf->dptr = buf->data + offset;
+    }
+
+    if (mutt_socket_readchar (idata->conn, &c) != 1)
+    {
+      dprint (1, (debugfile, "imap_read_literal_buf: error during read, %ld bytes read\n", pos));
+      idata->status = IMAP_FATAL;
+      *buf->dptr = '\0';
+
+      return -1;
+    }
+
+    if (r == 1 && c != '\n')
+      *buf->dptr++ = '\r';
+
+    if (c == '\r')
+    {
+      r = 1;
+      continue;
+    }
+    else
+      r = 0;
+
+    *buf->dptr++ = c;
+#ifdef DEBUG
+    if (debuglevel >= IMAP_LOG_LTRL)
+      fputc (c, debugfile);
+#endif
+  }
+  *buf->dptr = '\0';
+
+  return 0;
+}
+
 /* imap_read_literal: read bytes bytes from server into file. Not explicitly
  *   buffered, relies on FILE buffering. NOTE: strips \r from \r\n.
- *   Apparently even literals use \r\n-terminated strings ?! */
+ *   Apparently even literals use \r\n-terminated strings ?!
+ *   If fp is NULL the literal is read and discarded. */
 int imap_read_literal (FILE* fp, IMAP_DATA* idata, long bytes, progress_t* pbar)
 {
   long pos;
@@ -219,7 +283,7 @@ int imap_read_literal (FILE* fp, IMAP_DATA* idata, long bytes, progress_t* pbar)
     }
 
 #if 1
-    if (r == 1 && c != '\n')
+    if (r == 1 && c != '\n' && fp)
       fputc ('\r', fp);
 
     if (c == '\r')
@@ -230,7 +294,8 @@ int imap_read_literal (FILE* fp, IMAP_DATA* idata, long bytes, progress_t* pbar)
     else
       r = 0;
 #endif
-    fputc (c, fp);
+    if (fp)
+      fputc (c, fp);
 
     if (pbar && !(pos % 1024))
       mutt_progress_update (pbar, pos, -1);
@@ -345,6 +410,8 @@ IMAP_DATA* imap_conn_find (const ACCOUNT* account, int flags)
     }
     if (flags & MUTT_IMAP_CONN_NOSELECT && idata && idata->state >= IMAP_SELECTED)
       continue;
+    if (flags & MUTT_IMAP_CONN_NEW && idata)
+      continue;
     if (idata && idata->status == IMAP_FATAL)
       continue;
     break;
@@ -1056,25 +1123,12 @@ static int compare_flags (HEADER* h)
   return 0;
 }
 
-/* Update the IMAP server to reflect the flags a single message.  */
-int imap_sync_message (IMAP_DATA *idata, HEADER *hdr, BUFFER *cmd,
-		       int *err_continue)
+/* store_flags: write to buf the data item of a UID STORE that gives the
+ *   server Mutt's flags for hdr, custom keywords included. Returns -1 if
+ *   there are no flags we have the rights to store. */
+static int store_flags (IMAP_DATA* idata, HEADER* hdr, char* buf, size_t buflen)
 {
   char flags[LONG_STRING];
-  char uid[11];
-
-  hdr->changed = 0;
-
-  if (!compare_flags (hdr))
-  {
-    idata->ctx->changed--;
-    return 0;
-  }
-
-  snprintf (uid, sizeof (uid), "%u", HEADER_DATA(hdr)->uid);
-  cmd->dptr = cmd->data;
-  mutt_buffer_addstr (cmd, "UID STORE ");
-  mutt_buffer_addstr (cmd, uid);
 
   flags[0] = '\0';
 
@@ -1107,19 +1161,40 @@ int imap_sync_message (IMAP_DATA *idata, HEADER *hdr, BUFFER *cmd,
 
     mutt_remove_trailing_ws (flags);
 
-    mutt_buffer_addstr (cmd, " -FLAGS.SILENT (");
-  } else
-    mutt_buffer_addstr (cmd, " FLAGS.SILENT (");
+    snprintf (buf, buflen, "-FLAGS.SILENT (%s)", flags);
+  }
+  else
+    snprintf (buf, buflen, "FLAGS.SILENT (%s)", flags);
 
-  mutt_buffer_addstr (cmd, flags);
-  mutt_buffer_addstr (cmd, ")");
+  /* after all this it's still possible to have no flags, if you
+   * have no ACL rights */
+  return *flags ? 0 : -1;
+}
+
+/* Update the IMAP server to reflect the flags a single message.  */
+int imap_sync_message (IMAP_DATA *idata, HEADER *hdr, BUFFER *cmd,
+		       int *err_continue)
+{
+  char flags[LONG_STRING];
+  int rc;
+
+  hdr->changed = 0;
+
+  if (!compare_flags (hdr))
+  {
+    idata->ctx->changed--;
+    return 0;
+  }
+
+  rc = store_flags (idata, hdr, flags, sizeof (flags));
+
+  cmd->dptr = cmd->data;
+  mutt_buffer_printf (cmd, "UID STORE %u %s", HEADER_DATA(hdr)->uid, flags);
 
   /* dumb hack for bad UW-IMAP 4.7 servers spurious FLAGS updates */
   hdr->active = 0;
 
-  /* after all this it's still possible to have no flags, if you
-   * have no ACL rights */
-  if (*flags && (imap_exec (idata, cmd->data, 0) != 0) &&
+  if (rc == 0 && (imap_exec (idata, cmd->data, 0) != 0) &&
       err_continue && (*err_continue != MUTT_YES))
   {
     *err_continue = imap_continue ("imap_sync_message: STORE failed",
@@ -1134,6 +1209,108 @@ int imap_sync_message (IMAP_DATA *idata, HEADER *hdr, BUFFER *cmd,
   return 0;
 }
 
+/* a message imap_sync_tagged is storing flags for */
+typedef struct
+{
+  HEADER* h;
+  char* item;	/* the STORE data item */
+} FLAG_STORE;
+
+/* order by flags, then by position in the mailbox */
+static int compare_flag_store (const void* a, const void* b)
+{
+  const FLAG_STORE* sa = (const FLAG_STORE*) a;
+  const FLAG_STORE* sb = (const FLAG_STORE*) b;
+  int r;
+
+  if ((r = mutt_strcmp (sa->item, sb->item)))
+    return r;
+  return sa->h->index - sb->h->index;
+}
+
+/* imap_sync_tagged: imap_sync_message for every changed, tagged message.
+ *   Messages which end up with the same flags share UID STORE commands,
+ *   with neighbouring messages folded into UID ranges, and the commands
+ *   are pipelined. */
+int imap_sync_tagged (IMAP_DATA *idata, int *err_continue)
+{
+  CONTEXT* ctx = idata->ctx;
+  FLAG_STORE* st;
+  BUFFER* cmd;
+  HEADER* h;
+  char flags[LONG_STRING];
+  int i, j, k, n = 0;
+  int rc = 0;
+
+  st = safe_calloc (ctx->msgcount ? ctx->msgcount : 1, sizeof (FLAG_STORE));
+  for (i = 0; i < ctx->msgcount; i++)
+  {
+    h = ctx->hdrs[i];
+    if (!h->tagged || !h->active || !h->changed)
+      continue;
+
+    h->changed = 0;
+    ctx->changed--;
+    if (!compare_flags (h) || store_flags (idata, h, flags, sizeof (flags)) < 0)
+      continue;
+
+    st[n].h = h;
+    st[n].item = safe_strdup (flags);
+    n++;
+  }
+  if (!n)
+    goto out;
+
+  qsort (st, n, sizeof (FLAG_STORE), compare_flag_store);
+
+  cmd = mutt_buffer_new ();
+  for (i = 0; i < n && rc == 0; i = j)
+  {
+    cmd->dptr = cmd->data;
+    mutt_buffer_addstr (cmd, "UID STORE ");
+    for (j = i; j < n && !mutt_strcmp (st[j].item, st[i].item) &&
+           cmd->dptr - cmd->data < IMAP_MAX_CMDLEN; j = k + 1)
+    {
+      for (k = j; k + 1 < n && !mutt_strcmp (st[k + 1].item, st[j].item) &&
+             st[k + 1].h->index == st[k].h->index + 1; k++)
+        ;
+      mutt_buffer_printf (cmd, j > i ? ",%u" : "%u", HEADER_DATA(st[j].h)->uid);
+      if (k > j)
+        mutt_buffer_printf (cmd, ":%u", HEADER_DATA(st[k].h)->uid);
+    }
+    mutt_buffer_printf (cmd, " %s", st[i].item);
+
+    /* dumb hack for bad UW-IMAP 4.7 servers spurious FLAGS updates */
+    for (k = i; k < j; k++)
+      st[k].h->active = 0;
+
+    if (imap_exec (idata, cmd->data, IMAP_CMD_QUEUE) < 0)
+      rc = -1;
+  }
+  mutt_buffer_free (&cmd);
+
+  if (rc == 0 && imap_exec (idata, NULL, 0) != 0)
+    rc = -1;
+  if (rc < 0 && err_continue && *err_continue != MUTT_YES)
+  {
+    *err_continue = imap_continue ("imap_sync_tagged: STORE failed",
+				   idata->buf);
+    if (*err_continue == MUTT_YES)
+      rc = 0;
+  }
+  else
+    rc = 0;
+
+  for (i = 0; i < n; i++)
+    st[i].h->active = 1;
+
+out:
+  for (i = 0; i < n; i++)
+    FREE (&st[i].item);
+  FREE (&st);
+  return rc;
+}
+
 static int sync_helper (IMAP_DATA* idata, int right, int flag, const char* name)
 {
   int count = 0;
@@ -1863,6 +2040,154 @@ int imap_search (CONTEXT* ctx, const pattern_t* pat)
   return 0;
 }
 
+/* imap_sort_key: RFC 5256 sort key for a $sort value, or NULL if the
+ *   server can't sort that way */
+static const char* imap_sort_key (int method)
+{
+  switch (method & SORT_MASK)
+  {
+    case SORT_DATE:
+      return method & SORT_REVERSE ? "REVERSE DATE" : "DATE";
+    case SORT_RECEIVED:
+      return method & SORT_REVERSE ? "REVERSE ARRIVAL" : "ARRIVAL";
+    case SORT_FROM:
+      return method & SORT_REVERSE ? "REVERSE FROM" : "FROM";
+    case SORT_SIZE:
+      return method & SORT_REVERSE ? "REVERSE SIZE" : "SIZE";
+    case SORT_SUBJECT:
+      return method & SORT_REVERSE ? "REVERSE SUBJECT" : "SUBJECT";
+    case SORT_TO:
+      return method & SORT_REVERSE ? "REVERSE TO" : "TO";
+    default:
+      return NULL;
+  }
+}
+
+static int compare_uid (const void* a, const void* b)
+{
+  unsigned int ua = HEADER_DATA(*(HEADER**) a)->uid;
+  unsigned int ub = HEADER_DATA(*(HEADER**) b)->uid;
+
+  return ua < ub ? -1 : ua > ub;
+}
+
+/* sort_on_server: order ctx->hdrs with a server-side SORT instead of
+ *   sorting locally (see $imap_server_sort).
+ *   Returns 0 if ctx->hdrs is now sorted, -1 if the caller must sort. */
+static int sort_on_server (CONTEXT* ctx)
+{
+  IMAP_DATA* idata = (IMAP_DATA*) ctx->data;
+  IMAP_SORT sort;
+  HEADER** byuid = NULL;
+  HEADER keyh;
+  HEADER* key = &keyh;
+  HEADER** h;
+  IMAP_HEADER_DATA keydata;
+  char* seen = NULL;
+  const char* primary;
+  const char* aux;
+  char buf[STRING];
+  int reopen, i, n = 0;
+  int rc = -1;
+
+  if (!option (OPTIMAPSERVERSORT) || !idata || idata->ctx != ctx ||
+      idata->state < IMAP_SELECTED ||
+      !mutt_bit_isset (idata->capabilities, SORT) ||
+      !(primary = imap_sort_key (Sort)))
+    return -1;
+
+  /* the server falls back on sequence order, as we do */
+  if ((aux = imap_sort_key (SortAux)) && (SortAux & SORT_MASK) != (Sort & SORT_MASK))
+    snprintf (buf, sizeof (buf), "UID SORT (%s %s) US-ASCII ALL", primary, aux);
+  else
+    snprintf (buf, sizeof (buf), "UID SORT (%s) US-ASCII ALL", primary);
+
+  memset (&sort, 0, sizeof (sort));
+  idata->cmdtype = IMAP_CT_SORT;
+  idata->cmddata = &sort;
+  /* don't let new mail or expunges change ctx underneath us */
+  reopen = idata->reopen & IMAP_REOPEN_ALLOW;
+  idata->reopen &= ~IMAP_REOPEN_ALLOW;
+  i = imap_exec (idata, buf, 0);
+  idata->reopen |= reopen;
+  idata->cmddata = NULL;
+
+  /* an EXPUNGE during the SORT leaves its header with index -1 until the
+   * context catches up, so the indices can't be trusted then */
+  if (!(idata->reopen & IMAP_EXPUNGE_PENDING))
+    for (n = 0; n < ctx->msgcount; n++)
+      if (ctx->hdrs[n]->index < 0 || ctx->hdrs[n]->index >= ctx->msgcount)
+        break;
+  if (i != 0 || n < ctx->msgcount || sort.count < ctx->msgcount)
+  {
+    dprint (2, (debugfile, "imap_sort_headers: sorting locally (%d of %d)\n",
+                sort.count, ctx->msgcount));
+    goto out;
+  }
+
+  /* place every header at its position in the server's order; UIDs we
+   * don't know (new mail) are skipped, and a header the server didn't
+   * mention means we have to sort locally after all */
+  byuid = safe_malloc (ctx->msgcount * sizeof (HEADER*));
+  memcpy (byuid, ctx->hdrs, ctx->msgcount * sizeof (HEADER*));
+  qsort (byuid, ctx->msgcount, sizeof (HEADER*), compare_uid);
+
+  memset (&keyh, 0, sizeof (keyh));
+  keyh.data = &keydata;
+  seen = safe_calloc (ctx->msgcount, 1);
+  for (i = n = 0; i < sort.count; i++)
+  {
+    keydata.uid = sort.uids[i];
+    if (!(h = bsearch (&key, byuid, ctx->msgcount, sizeof (HEADER*),
+                       compare_uid)) || seen[(*h)->index])
+      continue;
+    seen[(*h)->index] = 1;
+    sort.uids[n++] = (*h)->index;
+  }
+
+  if (n != ctx->msgcount)
+  {
+    dprint (2, (debugfile, "imap_sort_headers: server sorted %d of %d messages\n",
+                n, ctx->msgcount));
+    goto out;
+  }
+
+  /* byuid doubles as the index -> header map */
+  for (i = 0; i < ctx->msgcount; i++)
+    byuid[ctx->hdrs[i]->index] = ctx->hdrs[i];
+  for (i = 0; i < n; i++)
+    ctx->hdrs[i] = byuid[sort.uids[i]];
+
+  rc = 0;
+
+out:
+  FREE (&seen);
+  FREE (&byuid);
+  FREE (&sort.uids);
+  return rc;
+}
+
+/* imap_sort_headers: the IMAP side of mutt_sort_headers. Has the server
+ *   sort ctx->hdrs if it can; otherwise makes sure the local sort will find
+ *   the envelopes it compares (see $imap_lazy_headers).
+ *   Returns 0 if ctx->hdrs is now sorted, -1 if the caller must sort. */
+int imap_sort_headers (CONTEXT* ctx)
+{
+  if (sort_on_server (ctx) == 0)
+    return 0;
+
+  switch (Sort & SORT_MASK)
+  {
+    case SORT_ORDER:
+    case SORT_RECEIVED:
+    case SORT_SIZE:
+      break;
+    default:
+      imap_fetch_envelopes (ctx, 0, ctx->msgcount);
+  }
+  return -1;
+}
+
 int imap_subscribe (char *path, int subscribe)
 {
   IMAP_DATA *idata;
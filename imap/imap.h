@@ -40,6 +40,7 @@ int imap_close_mailbox (CONTEXT *ctx);
 int imap_buffy_check (int force, int check_stats);
 int imap_status (char *path, int queue);
 int imap_search (CONTEXT* ctx, const pattern_t* pat);
+int imap_sort_headers (CONTEXT* ctx);
 int imap_subscribe (char *path, int subscribe);
 int imap_complete (char* dest, size_t dlen, char* path);
 int imap_fast_trash (CONTEXT* ctx, char* dest);
@@ -57,6 +58,9 @@ int imap_mailbox_rename (const char* mailbox);
 /* message.c */
 int imap_append_message (CONTEXT* ctx, MESSAGE* msg);
 int imap_copy_messages (CONTEXT* ctx, HEADER* h, char* dest, int delete);
+int imap_fetch_envelope (CONTEXT* ctx, HEADER* h);
+int imap_fetch_envelopes (CONTEXT* ctx, int msgno, int count);
+int imap_fetch_virtual_envelopes (CONTEXT* ctx, int first, int last);
 
 /* socket.c */
 void imap_logout_all (void);
@@ -60,6 +60,9 @@
  * lazy servers) */
 #define IMAP_MAX_CMDLEN 1024
 
+/* most of a literal we allocate before seeing it arrive */
+#define IMAP_LITERAL_PREALLOC (256 * 1024)
+
 #define IMAP_REOPEN_ALLOW     (1<<0)
 #define IMAP_EXPUNGE_EXPECTED (1<<1)
 #define IMAP_EXPUNGE_PENDING  (1<<2)
@@ -116,6 +119,7 @@ enum
   IDLE,                         /* RFC 2177: IDLE */
   SASL_IR,                      /* SASL initial response draft */
   ENABLE,                       /* RFC 5161 */
+  SORT,                         /* RFC 5256 */
 
   CAPMAX
 };
@@ -123,6 +127,7 @@ enum
 /* imap_conn_find flags */
 #define MUTT_IMAP_CONN_NONEW    (1<<0)
 #define MUTT_IMAP_CONN_NOSELECT (1<<1)
+#define MUTT_IMAP_CONN_NEW      (1<<2)
 
 /* -- data structures -- */
 typedef struct
@@ -152,6 +157,14 @@ typedef struct
   unsigned char noinferiors;
 } IMAP_LIST;
 
+/* UIDs of a SORT response, in server order */
+typedef struct
+{
+  unsigned int* uids;
+  int count;
+  int max;
+} IMAP_SORT;
+
 /* IMAP command structure */
 typedef struct
 {
@@ -163,7 +176,8 @@ typedef enum
 {
   IMAP_CT_NONE = 0,
   IMAP_CT_LIST,
-  IMAP_CT_STATUS
+  IMAP_CT_STATUS,
+  IMAP_CT_SORT
 } IMAP_COMMAND_TYPE;
 
 typedef struct
@@ -203,6 +217,9 @@ typedef struct
   int lastcmd;
   BUFFER* cmdbuf;
 
+  /* number of body prefetches in flight */
+  int prefetch;
+
   /* cache IMAP_STATUS of visited mailboxes */
   LIST* mboxcache;
 
@@ -213,6 +230,8 @@ typedef struct
   unsigned short check_status;
   unsigned char reopen;
   unsigned int newMailCount;
+  /* headers still waiting for their envelope ($imap_lazy_headers) */
+  int lazy;
   IMAP_CACHE cache[IMAP_CACHE_LEN];
   unsigned int uid_validity;
   unsigned int uidnext;
@@ -242,10 +261,12 @@ int imap_open_connection (IMAP_DATA* idata);
 void imap_close_connection (IMAP_DATA* idata);
 IMAP_DATA* imap_conn_find (const ACCOUNT* account, int flags);
 int imap_read_literal (FILE* fp, IMAP_DATA* idata, long bytes, progress_t*);
+int imap_read_literal_buf (BUFFER* buf, IMAP_DATA* idata, long bytes);
 void imap_expunge_mailbox (IMAP_DATA* idata);
 void imap_logout (IMAP_DATA** idata);
 int imap_sync_message (IMAP_DATA *idata, HEADER *hdr, BUFFER *cmd,
   int *err_continue);
+int imap_sync_tagged (IMAP_DATA *idata, int *err_continue);
 int imap_has_flag (LIST* flag_list, const char* flag);
 
 /* auth.c */
@@ -269,6 +290,9 @@ int imap_cache_del (IMAP_DATA* idata, HEADER* h);
 int imap_cache_clean (IMAP_DATA* idata);
 
 int imap_fetch_message (CONTEXT *ctx, MESSAGE *msg, int msgno);
+void imap_prefetch (CONTEXT *ctx, int msgno);
+int imap_prefetch_parse (IMAP_DATA* idata, int msgno, char* s);
+void imap_prefetch_done (IMAP_DATA* idata);
 int imap_close_message (CONTEXT *ctx, MESSAGE *msg);
 int imap_commit_message (CONTEXT *ctx, MESSAGE *msg);
 
@@ -30,6 +30,7 @@
 
 #include "mutt.h"
 #include "imap_private.h"
+#include "mime.h"
 #include "mx.h"
 
 #ifdef HAVE_PGP
@@ -42,15 +43,41 @@
 
 #include "bcache.h"
 
+/* fewest headers worth giving to each connection of a parallel download */
+#define IMAP_FETCH_SPLIT_MIN 500
+
+/* messages whose envelopes are filled in along with a missing one */
+#define IMAP_ENVELOPE_BATCH 500
+
+/* one connection of a parallel header download */
+typedef struct
+{
+  IMAP_DATA* idata;
+  BUFFER* hdrbuf;
+  int done;
+} FETCH_CONN;
+
+static body_cache_t *msg_cache_open (IMAP_DATA *idata);
 static FILE* msg_cache_get (IMAP_DATA* idata, HEADER* h);
 static FILE* msg_cache_put (IMAP_DATA* idata, HEADER* h);
 static int msg_cache_commit (IMAP_DATA* idata, HEADER* h);
 
 static void flush_buffer(char* buf, size_t* len, CONNECTION* conn);
-static int msg_fetch_header (CONTEXT* ctx, IMAP_HEADER* h, char* buf,
-  FILE* fp);
+static char* msg_header_request (IMAP_DATA* idata);
+static int msg_fetch_header (IMAP_DATA* idata, IMAP_HEADER* h, char* buf,
+  BUFFER* hdrbuf);
+static ENVELOPE* msg_parse_envelope (HEADER* hdr, BUFFER* hdrbuf,
+  FILE* scratch);
+static HEADER* msg_new_header (IMAP_HEADER* h, BUFFER* hdrbuf, FILE* scratch);
+static void msg_complete_lazy (CONTEXT* ctx, HEADER* h, long hdrlen);
+static int msg_fetch_envelopes (CONTEXT* ctx, HEADER** want, int n);
+static IMAP_DATA* msg_fetch_open (IMAP_DATA* idata, int count);
+static void msg_fetch_close (IMAP_DATA* widata);
+static int msg_fetch_parallel (IMAP_DATA* idata, int msgbegin, int msgend,
+  const char* hdrreq, FILE* scratch, int* maxuid);
 static int msg_parse_fetch (IMAP_HEADER* h, char* s);
 static char* msg_parse_flags (IMAP_HEADER* h, char* s);
+static int msg_compare_uid (const void* a, const void* b);
 
 /* imap_read_headers:
  * Changed to read many headers instead of just one. It will return the
@@ -61,15 +88,18 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
 {
   CONTEXT* ctx;
   char *hdrreq = NULL;
-  FILE *fp;
+  BUFFER *hdrbuf = NULL;
+  FILE *fp = NULL;
+#ifndef USE_FMEMOPEN
   char tempfile[_POSIX_PATH_MAX];
+#endif
   int msgno, idx = msgbegin - 1;
   IMAP_HEADER h;
   IMAP_STATUS* status;
   int rc, mfhrc, oldmsgcount;
   int fetchlast = 0;
   int maxuid = 0;
-  static const char * const want_headers = "DATE FROM SUBJECT TO CC MESSAGE-ID REFERENCES CONTENT-TYPE CONTENT-DESCRIPTION IN-REPLY-TO REPLY-TO LINES LIST-POST X-LABEL X-KEYWORDS X-MOZILLA-KEYS KEYWORDS X-ORIGINAL-TO";
+  int lazy;
   progress_t progress;
   int retval = -1;
 
@@ -83,17 +113,7 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
 
   ctx = idata->ctx;
 
-  if (mutt_bit_isset (idata->capabilities,IMAP4REV1))
-  {
-    safe_asprintf (&hdrreq, "BODY.PEEK[HEADER.FIELDS (%s%s%s)]",
-                           want_headers, ImapHeaders ? " " : "", NONULL (ImapHeaders));
-  }
-  else if (mutt_bit_isset (idata->capabilities,IMAP4))
-  {
-    safe_asprintf (&hdrreq, "RFC822.HEADER.LINES (%s%s%s)",
-                           want_headers, ImapHeaders ? " " : "", NONULL (ImapHeaders));
-  }
-  else
+  if (!(hdrreq = msg_header_request (idata)))
   {	/* Unable to fetch headers for lower versions */
     mutt_error _("Unable to fetch headers from this IMAP server version.");
     mutt_sleep (2);	/* pause a moment to let the user see the error */
@@ -101,7 +121,9 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
   }
 
   /* instead of downloading all headers and then parsing them, we parse them
-   * as they come in. */
+   * as they come in. Each header is collected in memory; the parser wants a
+   * FILE, so without fmemopen() it goes through a single scratch file. */
+#ifndef USE_FMEMOPEN
   mutt_mktemp (tempfile, sizeof (tempfile));
   if (!(fp = safe_fopen (tempfile, "w+")))
   {
@@ -110,12 +132,16 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
     goto error_out_0;
   }
   unlink (tempfile);
+#endif
+  hdrbuf = mutt_buffer_new ();
 
   /* make sure context has room to hold the mailbox */
   while ((msgend) >= idata->ctx->hdrmax)
     mx_alloc_memory (idata->ctx);
 
   oldmsgcount = ctx->msgcount;
+  if (!oldmsgcount)
+    idata->lazy = 0;
   idata->reopen &= ~(IMAP_REOPEN_ALLOW|IMAP_NEWMAIL_PENDING);
   idata->newMailCount = 0;
 
@@ -169,7 +195,7 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
         if (!evalhc)
           continue;
 
-        if ((mfhrc = msg_fetch_header (ctx, &h, idata->buf, NULL)) == -1)
+        if ((mfhrc = msg_fetch_header (idata, &h, idata->buf, NULL)) == -1)
           continue;
         else if (mfhrc < 0)
 	{
@@ -229,6 +255,27 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
   }
 #endif /* USE_HCACHE */
 
+  /* a large mailbox can be opened with just the flags, the envelopes
+   * are fetched later by imap_fetch_envelopes */
+  lazy = ImapLazyHeaders > 0 && !oldmsgcount &&
+    msgend + 1 - msgbegin > ImapLazyHeaders;
+
+  /* split a large download across several connections */
+  if (!lazy && ImapFetchConnections > 1 && msgbegin == ctx->msgcount &&
+      mutt_bit_isset (idata->capabilities, IMAP4REV1))
+  {
+    if (msg_fetch_parallel (idata, msgbegin, msgend, hdrreq, fp, &maxuid) < 0)
+    {
+#if USE_HCACHE
+      imap_hcache_close (idata);
+#endif
+      goto error_out_1;
+    }
+    /* anything the extra connections could not supply is fetched below */
+    msgbegin = ctx->msgcount;
+    idx = msgbegin - 1;
+  }
+
   mutt_progress_init (&progress, _("Fetching message headers..."),
 		      MUTT_PROGRESS_MSG, ReadInc, msgend + 1);
 
@@ -242,13 +289,13 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
       char *cmd;
 
       fetchlast = msgend + 1;
-      safe_asprintf (&cmd, "FETCH %d:%d (UID FLAGS INTERNALDATE RFC822.SIZE %s)",
-                     msgno + 1, fetchlast, hdrreq);
+      safe_asprintf (&cmd, "FETCH %d:%d (UID FLAGS INTERNALDATE RFC822.SIZE%s%s)",
+                     msgno + 1, fetchlast, lazy ? "" : " ", lazy ? "" : hdrreq);
       imap_cmd_start (idata, cmd);
       FREE (&cmd);
     }
 
-    rewind (fp);
+    hdrbuf->dptr = hdrbuf->data;
     memset (&h, 0, sizeof (h));
     h.data = safe_calloc (1, sizeof (IMAP_HEADER_DATA));
 
@@ -264,12 +311,19 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
       if (rc != IMAP_CMD_CONTINUE)
 	break;
 
-      if ((mfhrc = msg_fetch_header (ctx, &h, idata->buf, fp)) == -1)
+      if ((mfhrc = msg_fetch_header (idata, &h, idata->buf, hdrbuf)) == -1)
 	continue;
       else if (mfhrc < 0)
 	break;
 
-      if (!ftello (fp))
+      if (lazy && !h.data->uid)
+      {
+        dprint (2, (debugfile, "imap_read_headers: ignoring fetch response "
+                    "without UID\n"));
+        mfhrc = -1;
+        continue;
+      }
+      if (!lazy && hdrbuf->dptr == hdrbuf->data)
       {
         dprint (2, (debugfile, "msg_fetch_header: ignoring fetch response with no body\n"));
         mfhrc = -1;
@@ -277,9 +331,6 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
         continue;
       }
 
-      /* make sure we don't get remnants from older larger message headers */
-      fputs ("\n\n", fp);
-
       idx++;
       if (idx > msgend)
       {
@@ -298,31 +349,17 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
 	continue;
       }
 
-      ctx->hdrs[idx] = mutt_new_header ();
-
-      ctx->hdrs[idx]->index = h.sid - 1;
-      /* messages which have not been expunged are ACTIVE (borrowed from mh
-       * folders) */
-      ctx->hdrs[idx]->active = 1;
-      ctx->hdrs[idx]->read = h.data->read;
-      ctx->hdrs[idx]->old = h.data->old;
-      ctx->hdrs[idx]->deleted = h.data->deleted;
-      ctx->hdrs[idx]->flagged = h.data->flagged;
-      ctx->hdrs[idx]->replied = h.data->replied;
-      ctx->hdrs[idx]->changed = h.data->changed;
-      ctx->hdrs[idx]->received = h.received;
-      ctx->hdrs[idx]->data = (void *) (h.data);
+      if (!(ctx->hdrs[idx] = msg_new_header (&h, hdrbuf, fp)))
+      {
+        mfhrc = -2;
+        break;
+      }
 
       if (maxuid < h.data->uid)
         maxuid = h.data->uid;
+      if (HEADER_DATA(ctx->hdrs[idx])->lazy)
+        idata->lazy++;
 
-      rewind (fp);
-      /* NOTE: if Date: header is missing, mutt_read_rfc822_header depends
-       *   on h.received being set */
-      ctx->hdrs[idx]->env = mutt_read_rfc822_header (fp, ctx->hdrs[idx],
-        0, 0);
-      /* content built as a side-effect of mutt_read_rfc822_header */
-      ctx->hdrs[idx]->content->length = h.content_length;
       ctx->size += h.content_length;
 
 #if USE_HCACHE
@@ -385,6 +422,7 @@ int imap_read_headers (IMAP_DATA* idata, int msgbegin, int msgend)
 
 error_out_1:
   safe_fclose (&fp);
+  mutt_buffer_free (&hdrbuf);
 
 error_out_0:
   FREE (&hdrreq);
@@ -415,10 +453,18 @@ int imap_fetch_message (CONTEXT *ctx, MESSAGE *msg, int msgno)
   idata = (IMAP_DATA*) ctx->data;
   h = ctx->hdrs[msgno];
 
+  /* if this body is already on its way, let it land in the cache */
+  while (HEADER_DATA(h)->prefetch &&
+         imap_cmd_step (idata) == IMAP_CMD_CONTINUE)
+    ;
+
   if ((msg->fp = msg_cache_get (idata, h)))
   {
     if (HEADER_DATA(h)->parsed)
+    {
+      imap_prefetch (ctx, msgno);
       return 0;
+    }
     else
       goto parsemsg;
   }
@@ -474,6 +520,9 @@ int imap_fetch_message (CONTEXT *ctx, MESSAGE *msg, int msgno)
 
     pc = idata->buf;
     pc = imap_next_word (pc);
+    /* responses to prefetches still in flight have been dealt with */
+    if (atoi (pc) != h->index + 1)
+      continue;
     pc = imap_next_word (pc);
 
     if (!ascii_strncasecmp ("FETCH", pc, 5))
@@ -582,6 +631,12 @@ int imap_fetch_message (CONTEXT *ctx, MESSAGE *msg, int msgno)
   mutt_clear_error();
   rewind (msg->fp);
   HEADER_DATA(h)->parsed = 1;
+  /* the whole header has been read now, its lines are the ones before
+   * the body offset */
+  if (HEADER_DATA(h)->lazy)
+    msg_complete_lazy (ctx, h, h->content->offset);
+
+  imap_prefetch (ctx, msgno);
 
   return 0;
 
@@ -597,6 +652,366 @@ bail:
   return -1;
 }
 
+/* imap_prefetch: queue downloads of the bodies of the messages following
+ *   msgno in the index, as far as the pipeline has free slots, so they are
+ *   in the body cache by the time the user gets there. The responses are
+ *   consumed by imap_prefetch_parse whenever the connection is next read. */
+void imap_prefetch (CONTEXT *ctx, int msgno)
+{
+  IMAP_DATA* idata = (IMAP_DATA*) ctx->data;
+  HEADER* h;
+  char id[_POSIX_PATH_MAX];
+  char buf[SHORT_STRING];
+  int v, last, queued = 0;
+
+  if (ImapPrefetch <= 0 || idata->ctx != ctx ||
+      idata->state != IMAP_SELECTED ||
+      !mutt_bit_isset (idata->capabilities, IMAP4REV1) ||
+      idata->cmdbuf->dptr != idata->cmdbuf->data ||
+      (v = ctx->hdrs[msgno]->virtual) < 0)
+    return;
+
+  if (!(idata->bcache = msg_cache_open (idata)))
+    return;
+
+  last = MIN (ctx->vcount - 1, v + ImapPrefetch);
+  for (v++; v <= last; v++)
+  {
+    /* keep a slot free for whatever the user does next */
+    if ((idata->nextcmd - idata->lastcmd + idata->cmdslots) % idata->cmdslots
+        + 2 >= idata->cmdslots)
+      break;
+
+    h = ctx->hdrs[ctx->v2r[v]];
+    if (h->deleted || HEADER_DATA(h)->prefetch ||
+        (ImapPrefetchMaxSize > 0 &&
+         h->content->length > ImapPrefetchMaxSize * 1024L))
+      continue;
+    snprintf (id, sizeof (id), "%u-%u", idata->uid_validity,
+              HEADER_DATA(h)->uid);
+    if (mutt_bcache_exists (idata->bcache, id) == 0)
+      continue;
+
+    snprintf (buf, sizeof (buf), "UID FETCH %u BODY.PEEK[]",
+              HEADER_DATA(h)->uid);
+    if (imap_exec (idata, buf, IMAP_CMD_QUEUE) < 0)
+      break;
+    HEADER_DATA(h)->prefetch = 1;
+    idata->prefetch++;
+    queued++;
+  }
+
+  if (queued)
+  {
+    dprint (2, (debugfile, "imap_prefetch: %d bodies requested\n", queued));
+    imap_cmd_start (idata, NULL);
+  }
+}
+
+/* imap_prefetch_parse: handle an untagged FETCH response carrying a whole
+ *   message body while prefetches are in flight. s points to "FETCH".
+ *   The body of a prefetched message is stored in the body cache; one for a
+ *   message which has gone away (eg the folder was closed) is discarded.
+ *   Returns 1 if the response was consumed, 0 if it is somebody else's,
+ *   eg imap_fetch_message reading its own message. */
+int imap_prefetch_parse (IMAP_DATA* idata, int msgno, char* s)
+{
+  HEADER* h = NULL;
+  FILE* fp = NULL;
+  long bytes;
+  int cur;
+  char c;
+
+  if (!(s = strstr (s, "BODY[] {")) ||
+      imap_get_literal_count (s + 7, &bytes) < 0)
+    return 0;
+
+  if (idata->ctx && msgno <= idata->ctx->msgcount)
+    for (cur = 0; cur < idata->ctx->msgcount; cur++)
+      if (idata->ctx->hdrs[cur] && idata->ctx->hdrs[cur]->data &&
+          idata->ctx->hdrs[cur]->index + 1 == msgno)
+      {
+        h = idata->ctx->hdrs[cur];
+        break;
+      }
+
+  if (h && !HEADER_DATA(h)->prefetch)
+  {
+    /* inactive means imap_fetch_message is reading it */
+    if (!h->active)
+      return 0;
+    h = NULL;
+  }
+
+  if (h)
+  {
+    HEADER_DATA(h)->prefetch = 0;
+    idata->prefetch--;
+    fp = msg_cache_put (idata, h);
+  }
+  dprint (2, (debugfile, "imap_prefetch_parse: %s %ld bytes of message %d\n",
+              fp ? "caching" : "discarding", bytes, msgno));
+
+  if (imap_read_literal (fp, idata, bytes, NULL) == 0)
+  {
+    /* the rest of the response, normally just ")" */
+    do
+    {
+      if (mutt_socket_readchar (idata->conn, &c) != 1)
+      {
+        idata->status = IMAP_FATAL;
+        break;
+      }
+    }
+    while (c != '\n');
+  }
+
+  if (fp)
+  {
+    if (idata->status == IMAP_FATAL || fflush (fp) != 0 || ferror (fp))
+    {
+      safe_fclose (&fp);
+      imap_cache_del (idata, h);
+    }
+    else
+    {
+      safe_fclose (&fp);
+      msg_cache_commit (idata, h);
+    }
+  }
+
+  return 1;
+}
+
+/* imap_prefetch_done: the command queue has drained, so prefetches still
+ *   marked in flight were refused by the server. */
+void imap_prefetch_done (IMAP_DATA* idata)
+{
+  int i;
+
+  if (idata->ctx)
+    for (i = 0; i < idata->ctx->msgcount; i++)
+      if (idata->ctx->hdrs[i] && idata->ctx->hdrs[i]->data)
+        HEADER_DATA(idata->ctx->hdrs[i])->prefetch = 0;
+  idata->prefetch = 0;
+}
+
+/* imap_fetch_envelope: make sure h, one of the headers of ctx, has its
+ *   envelope, filling in those of the messages after it at the same time.
+ *   Returns the number of envelopes fetched, or -1 on failure. */
+int imap_fetch_envelope (CONTEXT* ctx, HEADER* h)
+{
+  if (!ctx || ctx->magic != MUTT_IMAP || h->msgno < 0 ||
+      h->msgno >= ctx->msgcount || ctx->hdrs[h->msgno] != h ||
+      !h->data || !HEADER_DATA(h)->lazy)
+    return 0;
+
+  return imap_fetch_envelopes (ctx, h->msgno, IMAP_ENVELOPE_BATCH);
+}
+
+static int msg_lazy (CONTEXT* ctx)
+{
+  IMAP_DATA* idata;
+
+  return ctx && ctx->magic == MUTT_IMAP && (idata = (IMAP_DATA*) ctx->data) &&
+    idata->lazy && idata->ctx == ctx && idata->state >= IMAP_SELECTED;
+}
+
+/* imap_fetch_envelopes: fill in the envelopes of the lazy headers (see
+ *   $imap_lazy_headers) among ctx->hdrs[msgno .. msgno + count - 1].
+ *   Returns the number of envelopes fetched, or -1 on failure. */
+int imap_fetch_envelopes (CONTEXT* ctx, int msgno, int count)
+{
+  HEADER** want;
+  int i, last, n = 0;
+
+  if (!msg_lazy (ctx))
+    return 0;
+
+  if (msgno < 0)
+    msgno = 0;
+  last = count < ctx->msgcount - msgno ? msgno + count : ctx->msgcount;
+  for (i = msgno; i < last; i++)
+    if (ctx->hdrs[i]->data && HEADER_DATA(ctx->hdrs[i])->lazy)
+      n++;
+  if (!n)
+    return 0;
+
+  want = safe_malloc (n * sizeof (HEADER*));
+  for (i = msgno, n = 0; i < last; i++)
+    if (ctx->hdrs[i]->data && HEADER_DATA(ctx->hdrs[i])->lazy)
+      want[n++] = ctx->hdrs[i];
+
+  return msg_fetch_envelopes (ctx, want, n);
+}
+
+/* imap_fetch_virtual_envelopes: as imap_fetch_envelopes, for the messages
+ *   shown at virtual positions first .. last. Under a limit those can be
+ *   far apart in ctx->hdrs, so only the ones shown are asked for. */
+int imap_fetch_virtual_envelopes (CONTEXT* ctx, int first, int last)
+{
+  HEADER** want;
+  HEADER* h;
+  int i, n = 0;
+
+  if (!msg_lazy (ctx))
+    return 0;
+
+  if (first < 0)
+    first = 0;
+  if (last >= ctx->vcount)
+    last = ctx->vcount - 1;
+  if (last < first)
+    return 0;
+
+  want = safe_malloc ((last - first + 1) * sizeof (HEADER*));
+  for (i = first; i <= last; i++)
+  {
+    h = ctx->hdrs[ctx->v2r[i]];
+    if (h->data && HEADER_DATA(h)->lazy)
+      want[n++] = h;
+  }
+  if (!n)
+  {
+    FREE (&want);
+    return 0;
+  }
+
+  return msg_fetch_envelopes (ctx, want, n);
+}
+
+/* msg_fetch_envelopes: fetch the envelopes of the n lazy headers in want,
+ *   which it frees. Returns the number fetched, or -1 on failure. */
+static int msg_fetch_envelopes (CONTEXT* ctx, HEADER** want, int n)
+{
+  IMAP_DATA* idata = (IMAP_DATA*) ctx->data;
+  HEADER** found;
+  HEADER* hdr;
+  HEADER keyh;
+  HEADER* key = &keyh;
+  IMAP_HEADER h;
+  IMAP_HEADER_DATA hd, keydata;
+  ENVELOPE* env;
+  BUFFER* cmd = NULL;
+  BUFFER* hdrbuf = NULL;
+  FILE* fp = NULL;
+#ifndef USE_FMEMOPEN
+  char tempfile[_POSIX_PATH_MAX];
+#endif
+  char* hdrreq = NULL;
+  progress_t progress;
+  unsigned int uid;
+  int i, j, first;
+  int rc, reopen, fetched = 0;
+  int retval = -1;
+
+  qsort (want, n, sizeof (HEADER*), msg_compare_uid);
+
+  if (!(hdrreq = msg_header_request (idata)))
+    goto out;
+#ifndef USE_FMEMOPEN
+  mutt_mktemp (tempfile, sizeof (tempfile));
+  if (!(fp = safe_fopen (tempfile, "w+")))
+  {
+    mutt_error (_("Could not create temporary file %s"), tempfile);
+    goto out;
+  }
+  unlink (tempfile);
+#endif
+  hdrbuf = mutt_buffer_new ();
+  cmd = mutt_buffer_new ();
+
+  /* only a big batch is worth a progress bar; the index asks for a
+   * screenful at a time */
+  if (n > ImapLazyHeaders && !ctx->quiet)
+    mutt_progress_init (&progress, _("Fetching message headers..."),
+                        MUTT_PROGRESS_MSG, ReadInc, n);
+
+  memset (&keyh, 0, sizeof (keyh));
+  keyh.data = &keydata;
+
+  /* don't let new mail or expunges change ctx underneath us */
+  reopen = idata->reopen & IMAP_REOPEN_ALLOW;
+  idata->reopen &= ~IMAP_REOPEN_ALLOW;
+#if USE_HCACHE
+  idata->hcache = imap_hcache_open (idata, NULL);
+#endif
+
+  for (first = 0, rc = IMAP_CMD_OK; first < n && rc == IMAP_CMD_OK; first = i)
+  {
+    /* as many runs of UIDs as fit on one command line */
+    cmd->dptr = cmd->data;
+    mutt_buffer_addstr (cmd, "UID FETCH ");
+    for (i = first; i < n && cmd->dptr - cmd->data < IMAP_MAX_CMDLEN; i = j + 1)
+    {
+      uid = HEADER_DATA(want[i])->uid;
+      for (j = i; j + 1 < n && HEADER_DATA(want[j + 1])->uid == uid + j + 1 - i; j++)
+        ;
+      if (j > i)
+        mutt_buffer_printf (cmd, "%s%u:%u", i > first ? "," : "", uid,
+                            HEADER_DATA(want[j])->uid);
+      else
+        mutt_buffer_printf (cmd, "%s%u", i > first ? "," : "", uid);
+    }
+    mutt_buffer_printf (cmd, " (UID %s)", hdrreq);
+
+    imap_cmd_start (idata, cmd->data);
+    while ((rc = imap_cmd_step (idata)) == IMAP_CMD_CONTINUE)
+    {
+      hdrbuf->dptr = hdrbuf->data;
+      memset (&h, 0, sizeof (h));
+      memset (&hd, 0, sizeof (hd));
+      h.data = &hd;
+
+      /* a corrupt response only costs that message its envelope */
+      j = msg_fetch_header (idata, &h, idata->buf, hdrbuf);
+      mutt_free_list (&hd.keywords);
+
+      keydata.uid = hd.uid;
+      if (j < 0 || hdrbuf->dptr == hdrbuf->data ||
+          !(found = bsearch (&key, want + first, i - first, sizeof (HEADER*),
+                             msg_compare_uid)) ||
+          !HEADER_DATA(hdr = *found)->lazy ||
+          !(env = msg_parse_envelope (hdr, hdrbuf, fp)))
+        continue;
+
+      mutt_merge_envelopes (hdr->env, &env);
+      /* the size was RFC822.SIZE, as for an eager fetch take off the
+       * header lines */
+      hdr->content->length -= hdrbuf->dptr - hdrbuf->data;
+#if defined(HAVE_PGP) || defined(HAVE_SMIME)
+      hdr->security = crypt_query (hdr->content);
+#endif
+      msg_complete_lazy (ctx, hdr, hdrbuf->dptr - hdrbuf->data);
+#if USE_HCACHE
+      imap_hcache_put (idata, hdr);
+#endif
+      fetched++;
+      if (n > ImapLazyHeaders && !ctx->quiet)
+        mutt_progress_update (&progress, fetched, -1);
+    }
+  }
+
+#if USE_HCACHE
+  imap_hcache_close (idata);
+#endif
+  idata->reopen |= reopen;
+
+  if (rc == IMAP_CMD_OK)
+    retval = fetched;
+  else
+    dprint (1, (debugfile, "imap_fetch_envelopes: fetch failed after %d of %d\n",
+                fetched, n));
+
+out:
+  FREE (&want);
+  FREE (&hdrreq);
+  mutt_buffer_free (&cmd);
+  mutt_buffer_free (&hdrbuf);
+  safe_fclose (&fp);
+  return retval;
+}
+
 int imap_close_message (CONTEXT *ctx, MESSAGE *msg)
 {
   return safe_fclose (&msg->fp);
@@ -813,17 +1228,12 @@ int imap_copy_messages (CONTEXT* ctx, HEADER* h, char* dest, int delete)
           dprint (3, (debugfile, "imap_copy_messages: Message contains attachments to be deleted\n"));
           return 1;
         }
+      }
 
-        if (ctx->hdrs[n]->tagged && ctx->hdrs[n]->active &&
-            ctx->hdrs[n]->changed)
-        {
-          rc = imap_sync_message (idata, ctx->hdrs[n], &sync_cmd, &err_continue);
-          if (rc < 0)
-          {
-            dprint (1, (debugfile, "imap_copy_messages: could not sync\n"));
-            goto out;
-          }
-        }
+      if ((rc = imap_sync_tagged (idata, &err_continue)) < 0)
+      {
+        dprint (1, (debugfile, "imap_copy_messages: could not sync\n"));
+        goto out;
       }
 
       rc = imap_exec_msgset (idata, "UID COPY", mmbox, MUTT_TAG, 0, 0);
@@ -1095,20 +1505,39 @@ char* imap_set_flags (IMAP_DATA* idata, HEADER* h, char* s)
 }
 
 
+/* msg_header_request: the FETCH item for the header fields Mutt keeps,
+ *   or NULL if the server can't send them */
+static char* msg_header_request (IMAP_DATA* idata)
+{
+  static const char * const want_headers = "DATE FROM SUBJECT TO CC MESSAGE-ID REFERENCES CONTENT-TYPE CONTENT-DESCRIPTION IN-REPLY-TO REPLY-TO LINES LIST-POST X-LABEL X-KEYWORDS X-MOZILLA-KEYS KEYWORDS X-ORIGINAL-TO";
+  char* hdrreq = NULL;
+
+  if (mutt_bit_isset (idata->capabilities,IMAP4REV1))
+  {
+    safe_asprintf (&hdrreq, "BODY.PEEK[HEADER.FIELDS (%s%s%s)]",
+                           want_headers, ImapHeaders ? " " : "", NONULL (ImapHeaders));
+  }
+  else if (mutt_bit_isset (idata->capabilities,IMAP4))
+  {
+    safe_asprintf (&hdrreq, "RFC822.HEADER.LINES (%s%s%s)",
+                           want_headers, ImapHeaders ? " " : "", NONULL (ImapHeaders));
+  }
+
+  return hdrreq;
+}
+
 /* msg_fetch_header: import IMAP FETCH response into an IMAP_HEADER.
  *   Expects string beginning with * n FETCH.
  *   Returns:
  *      0 on success
  *     -1 if the string is not a fetch response
  *     -2 if the string is a corrupt fetch response */
-static int msg_fetch_header (CONTEXT* ctx, IMAP_HEADER* h, char* buf, FILE* fp)
+static int msg_fetch_header (IMAP_DATA* idata, IMAP_HEADER* h, char* buf,
+                             BUFFER* hdrbuf)
 {
-  IMAP_DATA* idata;
   long bytes;
   int rc = -1; /* default now is that string isn't FETCH response*/
 
-  idata = (IMAP_DATA*) ctx->data;
-
   if (buf[0] != '*')
     return rc;
 
@@ -1128,12 +1557,12 @@ static int msg_fetch_header (CONTEXT* ctx, IMAP_HEADER* h, char* buf, FILE* fp)
 
   /* FIXME: current implementation - call msg_parse_fetch - if it returns -2,
    *   read header lines and call it again. Silly. */
-  if ((rc = msg_parse_fetch (h, buf)) != -2 || !fp)
+  if ((rc = msg_parse_fetch (h, buf)) != -2 || !hdrbuf)
     return rc;
 
   if (imap_get_literal_count (buf, &bytes) == 0)
   {
-    imap_read_literal (fp, idata, bytes, NULL);
+    imap_read_literal_buf (hdrbuf, idata, bytes);
 
     /* we may have other fields of the FETCH _after_ the literal
      * (eg Domino puts FLAGS here). Nothing wrong with that, either.
@@ -1155,6 +1584,343 @@ static int msg_fetch_header (CONTEXT* ctx, IMAP_HEADER* h, char* buf, FILE* fp)
   return rc;
 }
 
+/* msg_parse_envelope: run the header lines collected in hdrbuf through the
+ *   RFC 822 parser on behalf of hdr. scratch is only used when fmemopen()
+ *   is not. Returns NULL if the lines can't be handed to the parser. */
+static ENVELOPE* msg_parse_envelope (HEADER* hdr, BUFFER* hdrbuf, FILE* scratch)
+{
+  ENVELOPE* env;
+  FILE* fp;
+  size_t len = hdrbuf->dptr - hdrbuf->data;
+
+#ifdef USE_FMEMOPEN
+  if (!(fp = fmemopen (hdrbuf->data, len, "r")))
+    return NULL;
+#else
+  if (!(fp = scratch))
+    return NULL;
+  rewind (fp);
+  if (fwrite (hdrbuf->data, 1, len, fp) != len || fflush (fp) != 0 ||
+      ftruncate (fileno (fp), len) != 0)
+    return NULL;
+  rewind (fp);
+#endif
+
+  /* NOTE: if Date: header is missing, mutt_read_rfc822_header depends
+   *   on hdr->received being set */
+  env = mutt_read_rfc822_header (fp, hdr, 0, 0);
+
+  if (fp != scratch)
+    safe_fclose (&fp);
+
+  return env;
+}
+
+/* msg_complete_lazy: do for a lazy header which has just got its
+ *   envelope what mx_update_context does when a mailbox is opened.
+ *   hdrlen is the size of its header lines, which ctx->size still
+ *   counts from RFC822.SIZE. */
+static void msg_complete_lazy (CONTEXT* ctx, HEADER* h, long hdrlen)
+{
+  IMAP_DATA* idata = (IMAP_DATA*) ctx->data;
+
+  ctx->size -= hdrlen;
+  /* the index colour may depend on the envelope */
+  h->pair = 0;
+
+  if (h->env->supersedes)
+  {
+    HEADER* h2;
+
+    if (!ctx->id_hash)
+      ctx->id_hash = mutt_make_id_hash (ctx);
+
+    if ((h2 = hash_find (ctx->id_hash, h->env->supersedes)))
+    {
+      h2->superseded = 1;
+      if (option (OPTSCORE))
+        mutt_score_message (ctx, h2, 1);
+    }
+  }
+
+  if (ctx->id_hash && h->env->message_id)
+    hash_insert (ctx->id_hash, h->env->message_id, h, 0);
+  if (ctx->subj_hash && h->env->real_subj)
+    hash_insert (ctx->subj_hash, h->env->real_subj, h, 1);
+
+  HEADER_DATA(h)->lazy = 0;
+  idata->lazy--;
+
+  /* it was scored against an empty envelope when the mailbox was
+   * opened. The context counts already include it, so keep them up
+   * to date. */
+  if (option (OPTSCORE))
+    mutt_score_message (ctx, h, 1);
+}
+
+/* msg_new_header: build a HEADER from a parsed FETCH response and the
+ *   header lines that came with it in hdrbuf. Without any lines the
+ *   header is left lazy, for imap_fetch_envelopes to complete. Returns
+ *   NULL if the lines can't be handed to the parser. */
+static HEADER* msg_new_header (IMAP_HEADER* h, BUFFER* hdrbuf, FILE* scratch)
+{
+  HEADER* hdr;
+
+  hdr = mutt_new_header ();
+
+  hdr->index = h->sid - 1;
+  /* messages which have not been expunged are ACTIVE (borrowed from mh
+   * folders) */
+  hdr->active = 1;
+  hdr->read = h->data->read;
+  hdr->old = h->data->old;
+  hdr->deleted = h->data->deleted;
+  hdr->flagged = h->data->flagged;
+  hdr->replied = h->data->replied;
+  hdr->changed = h->data->changed;
+  hdr->received = h->received;
+
+  if (hdrbuf->dptr == hdrbuf->data)
+  {
+    /* the defaults mutt_read_rfc822_header would give an empty header */
+    hdr->env = mutt_new_envelope ();
+    hdr->content = mutt_new_body ();
+    hdr->content->type = TYPETEXT;
+    hdr->content->subtype = safe_strdup ("plain");
+    hdr->content->encoding = ENC7BIT;
+    hdr->content->disposition = DISPINLINE;
+    hdr->date_sent = hdr->received;
+    h->data->lazy = 1;
+  }
+  else if (!(hdr->env = msg_parse_envelope (hdr, hdrbuf, scratch)))
+  {
+    mutt_free_header (&hdr);
+    return NULL;
+  }
+
+  hdr->data = (void *) (h->data);
+  /* content built as a side-effect of mutt_read_rfc822_header */
+  hdr->content->length = h->content_length;
+
+  return hdr;
+}
+
+/* msg_fetch_open: open an extra connection to the server and EXAMINE the
+ *   mailbox selected on idata, for a parallel header download. Returns
+ *   NULL if the connection can't be used (the mailbox must hold at least
+ *   count messages and have the same UIDVALIDITY). */
+static IMAP_DATA* msg_fetch_open (IMAP_DATA* idata, int count)
+{
+  IMAP_DATA* widata;
+  char buf[LONG_STRING + 8];
+  char mbox[LONG_STRING];
+  char* s;
+  int exists = -1;
+  unsigned int uid_validity = 0;
+  int rc;
+
+  if (!(widata = imap_conn_find (&idata->conn->account, MUTT_IMAP_CONN_NEW)))
+    return NULL;
+  if (widata->state != IMAP_AUTHENTICATED)
+    goto fail;
+
+  imap_munge_mbox_name (widata, mbox, sizeof (mbox), idata->mailbox);
+  snprintf (buf, sizeof (buf), "EXAMINE %s", mbox);
+  imap_cmd_start (widata, buf);
+
+  /* the connection is never marked SELECTED, so EXISTS and friends are
+   * left for us to pick up here */
+  while ((rc = imap_cmd_step (widata)) == IMAP_CMD_CONTINUE)
+  {
+    s = imap_next_word (widata->buf);
+    if (isdigit ((unsigned char) *s) &&
+        !ascii_strncasecmp ("EXISTS", imap_next_word (s), 6))
+      exists = atoi (s);
+    else if (!ascii_strncasecmp ("OK [UIDVALIDITY", s, 14))
+    {
+      s += 3;
+      s = imap_next_word (s);
+      uid_validity = strtoul (s, NULL, 10);
+    }
+  }
+
+  if (rc != IMAP_CMD_OK || exists < count ||
+      uid_validity != idata->uid_validity)
+  {
+    dprint (2, (debugfile, "msg_fetch_open: can't use extra connection "
+                "(EXISTS %d, UIDVALIDITY %u)\n", exists, uid_validity));
+    goto fail;
+  }
+
+  return widata;
+
+fail:
+  msg_fetch_close (widata);
+  return NULL;
+}
+
+/* msg_fetch_close: log out of and discard an extra connection */
+static void msg_fetch_close (IMAP_DATA* widata)
+{
+  CONNECTION* conn = widata->conn;
+
+  if (widata->status != IMAP_FATAL && widata->state >= IMAP_AUTHENTICATED)
+    imap_logout ((IMAP_DATA**) (void*) &conn->data);
+  else
+  {
+    mutt_socket_close (conn);
+    imap_free_idata ((IMAP_DATA**) (void*) &conn->data);
+  }
+  mutt_socket_free (conn);
+}
+
+/* msg_fetch_parallel: fetch the headers of messages msgbegin..msgend over
+ *   idata and up to $imap_fetch_connections - 1 extra connections, each
+ *   downloading one contiguous slice. Headers are parked in ctx->hdrs at
+ *   their sequence number as they arrive from whichever connection, and
+ *   only the unbroken run of ascending UIDs from msgbegin is added to the
+ *   context; the caller fetches anything after a gap over idata alone.
+ *   Returns -1 if idata itself failed, 0 otherwise. */
+static int msg_fetch_parallel (IMAP_DATA* idata, int msgbegin, int msgend,
+                               const char* hdrreq, FILE* scratch, int* maxuid)
+{
+  CONTEXT* ctx = idata->ctx;
+  FETCH_CONN* fc;
+  IMAP_HEADER h;
+  HEADER* hdr;
+  progress_t progress;
+  char* cmd;
+  int count = msgend - msgbegin + 1;
+  int nconn, active, fetched = 0;
+  int first, last, i, rc, mfhrc;
+  unsigned int lastuid = 0;
+  int retval = 0;
+
+  if ((nconn = count / IMAP_FETCH_SPLIT_MIN) > ImapFetchConnections)
+    nconn = ImapFetchConnections;
+  if (nconn < 2)
+    return 0;
+
+  fc = safe_calloc (nconn, sizeof (FETCH_CONN));
+  fc[0].idata = idata;
+  for (active = 1; active < nconn; active++)
+    if (!(fc[active].idata = msg_fetch_open (idata, msgend + 1)))
+      break;
+  nconn = active;
+  if (nconn < 2)
+    goto out;
+
+  dprint (2, (debugfile, "msg_fetch_parallel: fetching %d headers over %d "
+              "connections\n", count, nconn));
+
+  for (i = 0; i < nconn; i++)
+    fc[i].hdrbuf = mutt_buffer_new ();
+
+  for (i = msgbegin; i <= msgend; i++)
+    ctx->hdrs[i] = NULL;
+
+  for (i = 0; i < nconn; i++)
+  {
+    first = msgbegin + (int) ((long) count * i / nconn);
+    last = msgbegin + (int) ((long) count * (i + 1) / nconn) - 1;
+    safe_asprintf (&cmd, "FETCH %d:%d (UID FLAGS INTERNALDATE RFC822.SIZE %s)",
+                   first + 1, last + 1, hdrreq);
+    imap_cmd_start (fc[i].idata, cmd);
+    FREE (&cmd);
+  }
+
+  mutt_progress_init (&progress, _("Fetching message headers..."),
+		      MUTT_PROGRESS_MSG, ReadInc, msgend + 1);
+
+  /* visit the connections in turn, draining whatever each has buffered,
+   * so that all of them keep streaming */
+  while (active)
+  {
+    for (i = 0; i < nconn; i++)
+    {
+      if (fc[i].done)
+        continue;
+
+      do
+      {
+        rc = imap_cmd_step (fc[i].idata);
+        if (rc != IMAP_CMD_CONTINUE)
+        {
+          fc[i].done = 1;
+          active--;
+          if (rc != IMAP_CMD_OK && !i)
+            retval = -1;
+          break;
+        }
+
+        fc[i].hdrbuf->dptr = fc[i].hdrbuf->data;
+        memset (&h, 0, sizeof (h));
+        h.data = safe_calloc (1, sizeof (IMAP_HEADER_DATA));
+        mfhrc = msg_fetch_header (fc[i].idata, &h, fc[i].idata->buf,
+                                  fc[i].hdrbuf);
+        if (mfhrc == 0 && fc[i].hdrbuf->dptr > fc[i].hdrbuf->data &&
+            h.sid > msgbegin && h.sid <= msgend + 1 && !ctx->hdrs[h.sid - 1])
+        {
+          if ((ctx->hdrs[h.sid - 1] = msg_new_header (&h, fc[i].hdrbuf,
+                                                      scratch)))
+          {
+            mutt_progress_update (&progress, msgbegin + ++fetched, -1);
+            continue;
+          }
+          mfhrc = -2;
+        }
+
+        imap_free_header_data (&h.data);
+        /* a corrupt response leaves the stream unusable */
+        if (mfhrc < -1)
+        {
+          fc[i].done = 1;
+          active--;
+          if (!i)
+            retval = -1;
+          break;
+        }
+      }
+      while (mutt_socket_poll (fc[i].idata->conn) > 0);
+    }
+  }
+
+  /* merge in UID order, stopping at the first gap */
+  if (msgbegin)
+    lastuid = HEADER_DATA(ctx->hdrs[msgbegin - 1])->uid;
+  for (i = msgbegin; i <= msgend && retval == 0; i++)
+  {
+    if (!(hdr = ctx->hdrs[i]) || HEADER_DATA(hdr)->uid <= lastuid)
+      break;
+    lastuid = HEADER_DATA(hdr)->uid;
+
+    if (*maxuid < lastuid)
+      *maxuid = lastuid;
+    ctx->size += hdr->content->length;
+#if USE_HCACHE
+    imap_hcache_put (idata, hdr);
+#endif /* USE_HCACHE */
+    ctx->msgcount++;
+  }
+  for (; i <= msgend; i++)
+    if ((hdr = ctx->hdrs[i]))
+    {
+      imap_free_header_data ((IMAP_HEADER_DATA**) (void*) &hdr->data);
+      mutt_free_header (&ctx->hdrs[i]);
+    }
+
+out:
+  for (i = 0; i < nconn; i++)
+  {
+    if (i)
+      msg_fetch_close (fc[i].idata);
+    mutt_buffer_free (&fc[i].hdrbuf);
+  }
+  FREE (&fc);
+
+  return retval;
+}
+
 /* msg_parse_fetch: handle headers returned from header fetch */
 static int msg_parse_fetch (IMAP_HEADER *h, char *s)
 {
@@ -1322,3 +2088,11 @@ static void flush_buffer(char *buf, size_t *len, CONNECTION *conn)
   mutt_socket_write_n(conn, buf, *len);
   *len = 0;
 }
+
+static int msg_compare_uid (const void* a, const void* b)
+{
+  unsigned int ua = HEADER_DATA(*(HEADER**) a)->uid;
+  unsigned int ub = HEADER_DATA(*(HEADER**) b)->uid;
+
+  return ua < ub ? -1 : ua > ub;
+}
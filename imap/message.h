@@ -35,6 +35,8 @@ typedef struct imap_header_data
   unsigned int changed : 1;
 
   unsigned int parsed : 1;
+  unsigned int prefetch : 1;	/* body download in flight */
+  unsigned int lazy : 1;	/* envelope not fetched yet */
 
   unsigned int uid;	/* 32-bit Message UID */
   LIST *keywords;
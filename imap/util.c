@@ -241,7 +241,8 @@ int imap_hcache_put (IMAP_DATA* idata, HEADER* h)
 {
   char key[16];
 
-  if (!idata->hcache)
+  /* the envelope of a lazy header is still empty */
+  if (!idata->hcache || HEADER_DATA (h)->lazy)
     return -1;
 
   sprintf (key, "/%u", HEADER_DATA (h)->uid);
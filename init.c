@@ -73,6 +73,10 @@ typedef struct myvar
 
 static myvar_t* MyVars;
 
+/* MuttVars and Commands by name, see mutt_init_lookup_tables() */
+static HASH *OptionsHash;
+static HASH *CommandsHash;
+
 static int var_to_string (int idx, char* val, size_t len);
 
 static void myvar_set (const char* var, const char* val);
@@ -133,14 +137,51 @@ int query_quadoption (int opt, const char *prompt)
    matches, or -1 if the variable is not found.  */
 static int mutt_option_index (char *s)
 {
+  struct option_t *opt;
   int i;
 
+  if (OptionsHash)
+  {
+    if (!s || !(opt = hash_find (OptionsHash, s)))
+      return (-1);
+    return (opt->type == DT_SYN ?  mutt_option_index ((char *) opt->data) : opt - MuttVars);
+  }
+
   for (i = 0; MuttVars[i].option; i++)
     if (mutt_strcmp (s, MuttVars[i].option) == 0)
       return (MuttVars[i].type == DT_SYN ?  mutt_option_index ((char *) MuttVars[i].data) : i);
   return (-1);
 }
 
+static const struct command_t *mutt_command_lookup (const char *s)
+{
+  int i;
+
+  if (CommandsHash)
+    return s ? hash_find (CommandsHash, s) : NULL;
+
+  for (i = 0; Commands[i].name; i++)
+    if (mutt_strcmp (s, Commands[i].name) == 0)
+      return &Commands[i];
+  return NULL;
+}
+
+/* Variables and commands are looked up for every line of the muttrc and
+   of every hook that runs, so they are found by hash rather than by
+   walking the tables. */
+static void mutt_init_lookup_tables (void)
+{
+  int i;
+
+  OptionsHash = hash_create (2 * (sizeof (MuttVars) / sizeof (MuttVars[0])), 0);
+  for (i = 0; MuttVars[i].option; i++)
+    hash_insert (OptionsHash, MuttVars[i].option, &MuttVars[i], 0);
+
+  CommandsHash = hash_create (2 * (sizeof (Commands) / sizeof (Commands[0])), 0);
+  for (i = 0; Commands[i].name; i++)
+    hash_insert (CommandsHash, Commands[i].name, (void *) &Commands[i], 0);
+}
+
 int mutt_extract_token (BUFFER *dest, BUFFER *tok, int flags)
 {
   char		ch;
@@ -694,16 +735,7 @@ static int parse_ifdef (BUFFER *tmp, BUFFER *s, unsigned long data, BUFFER *err)
 
   /* or a command? */
   if (!res)
-  {
-    for (i = 0; Commands[i].name; i++)
-    {
-      if (mutt_strcmp (tmp->data, Commands[i].name) == 0)
-      {
-        res = 1;
-        break;
-      }
-    }
-  }
+    res = (mutt_command_lookup (tmp->data) != NULL);
 
   if (!MoreArgs (s))
   {
@@ -2481,7 +2513,8 @@ static int parse_source (BUFFER *tmp, BUFFER *s, unsigned long data, BUFFER *err
    err		where to write error messages */
 int mutt_parse_rc_line (/* const */ char *line, BUFFER *token, BUFFER *err)
 {
-  int i, r = 0;
+  const struct command_t *cmd;
+  int r = 0;
   BUFFER expn;
 
   if (!line || !*line)
@@ -2504,23 +2537,18 @@ int mutt_parse_rc_line (/* const */ char *line, BUFFER *token, BUFFER *err)
       continue;
     }
     mutt_extract_token (token, &expn, 0);
-    for (i = 0; Commands[i].name; i++)
+    if ((cmd = mutt_command_lookup (token->data)))
     {
-      if (!mutt_strcmp (token->data, Commands[i].name))
-      {
-        r = Commands[i].func (token, &expn, Commands[i].data, err);
-        if (r != 0) {   /* -1 Error, +1 Finish */
-          goto finish;  /* Propagate return code */
-        }
-        break;          /* Continue with next command */
+      r = cmd->func (token, &expn, cmd->data, err);
+      if (r != 0) {   /* -1 Error, +1 Finish */
+        goto finish;  /* Propagate return code */
       }
+      continue;       /* Continue with next command */
     }
-    if (!Commands[i].name)
-    {
-      snprintf (err->data, err->dsize, _("%s: unknown command"), NONULL (token->data));
-      r = -1;
-      break;            /* Ignore the rest of the line */
-    }
+
+    snprintf (err->data, err->dsize, _("%s: unknown command"), NONULL (token->data));
+    r = -1;
+    break;            /* Ignore the rest of the line */
   }
 finish:
   if (expn.destroy)
@@ -3204,6 +3232,8 @@ void mutt_init (int skip_sys_rc, LIST *commands)
   err.data = safe_malloc(err.dsize);
   err.dptr = err.data;
 
+  mutt_init_lookup_tables ();
+
   Groups = hash_create (1031, 0);
   ReverseAlias = hash_create (1031, 1);
 #ifdef USE_NOTMUCH
@@ -1253,6 +1253,17 @@ struct option_t MuttVars[] = {
   ** as folder separators for displaying IMAP paths. In particular it
   ** helps in using the ``='' shortcut for your \fIfolder\fP variable.
   */
+  { "imap_fetch_connections", DT_NUM, R_NONE, UL &ImapFetchConnections, 1 },
+  /*
+  ** .pp
+  ** When opening a large IMAP mailbox whose headers are not in the header
+  ** cache, Mutt can download them over several connections at once.  This
+  ** variable sets the total number of connections to use; the extra ones
+  ** open the mailbox read-only and are logged out once the headers have
+  ** been merged.  Each connection is given at least 500 messages, so
+  ** small mailboxes are still fetched over a single connection.  Note
+  ** that some servers limit the number of concurrent connections per user.
+  */
   { "imap_headers",	DT_STR, R_INDEX, UL &ImapHeaders, UL 0},
   /*
   ** .pp
@@ -1287,6 +1298,20 @@ struct option_t MuttVars[] = {
   ** violated every now and then. Reduce this number if you find yourself
   ** getting disconnected from your IMAP server due to inactivity.
   */
+  { "imap_lazy_headers",	DT_NUM,  R_NONE, UL &ImapLazyHeaders, 0 },
+  /*
+  ** .pp
+  ** When opening an IMAP mailbox with more than this many message headers
+  ** to download (that is, not already in the header cache), Mutt fetches
+  ** only the flags, arrival date and size of each message up front.  The
+  ** remaining header fields are fetched in batches as the index comes to
+  ** display the messages, or when a search, limit, reply or sort needs
+  ** them.  Sorting by anything other than ``mailbox-order'',
+  ** ``date-received'', ``size'' or ``score'' fetches all of them, unless
+  ** the server does the sorting (see $$imap_server_sort).  Headers fetched
+  ** this way are not stored in the header cache until they are complete.
+  ** A value of 0 disables this.
+  */
   { "imap_list_subscribed",	DT_BOOL, R_NONE, OPTIMAPLSUB, 0 },
   /*
   ** .pp
@@ -1340,6 +1365,37 @@ struct option_t MuttVars[] = {
   ** .pp
   ** \fBNote:\fP Changes to this variable have no effect on open connections.
   */
+  { "imap_prefetch",	DT_NUM,  R_NONE, UL &ImapPrefetch, 0 },
+  /*
+  ** .pp
+  ** When opening a message, mutt queues downloads of up to this many of the
+  ** following messages in the index into the body cache, using free slots
+  ** in the command pipeline (see $$imap_pipeline_depth).  Bodies arrive
+  ** while you read, so moving on to the next message doesn't wait for the
+  ** server.  Requires $$message_cachedir.  Prefetching never marks messages
+  ** as read.  A value of 0 disables it.
+  ** .pp
+  ** Also see $$imap_prefetch_max_size.
+  */
+  { "imap_prefetch_max_size", DT_NUM, R_NONE, UL &ImapPrefetchMaxSize, 256 },
+  /*
+  ** .pp
+  ** Messages larger than this many kilobytes are not prefetched
+  ** (see $$imap_prefetch).  0 means no limit.
+  */
+  { "imap_server_sort",		DT_BOOL, R_NONE, OPTIMAPSERVERSORT, 0 },
+  /*
+  ** .pp
+  ** When set, and the server supports the SORT extension (RFC 5256), Mutt
+  ** asks the server to order IMAP mailboxes instead of sorting the
+  ** headers itself.  This applies to $$sort (and $$sort_aux as the
+  ** secondary key) set to \fIdate\fP, \fIdate-received\fP, \fIfrom\fP,
+  ** \fIsize\fP, \fIsubject\fP or \fIto\fP; other methods, including
+  ** threads, are always sorted locally.  The server compares addresses
+  ** rather than display names and sizes whole messages rather than
+  ** bodies, so ``from'', ``to'' and ``size'' may order slightly
+  ** differently from a local sort.
+  */
   { "imap_servernoise",		DT_BOOL, R_NONE, OPTIMAPSERVERNOISE, 1 },
   /*
   ** .pp
@@ -1596,7 +1652,7 @@ struct option_t MuttVars[] = {
   ** Check for Maildir unaware programs other than mutt having modified maildir
   ** files when the header cache is in use.  This incurs one \fCstat(2)\fP per
   ** message every time the folder is opened (which can be very slow for NFS
-  ** folders).
+  ** folders).  This also applies to the messages of notmuch virtual folders.
   */
 #endif
   { "maildir_trash", DT_BOOL, R_NONE, OPTMAILDIRTRASH, 0 },
@@ -1649,6 +1705,18 @@ struct option_t MuttVars[] = {
   ** .pp
   ** Also see the $$move variable.
   */
+  { "mbox_pad_status",	DT_BOOL, R_NONE, OPTMBOXPADSTATUS, 0 },
+  /*
+  ** .pp
+  ** When set, mutt always writes \fCStatus:\fP and \fCX-Status:\fP
+  ** headers when it rewrites an mbox or MMDF folder, padded so that any
+  ** combination of flags fits.  Later syncs which only change flags can
+  ** then overwrite these headers in place instead of rewriting the folder
+  ** from the first changed message to its end.
+  ** .pp
+  ** The padded headers are visible to other programs reading the folder,
+  ** which is why this is unset by default.
+  */
   { "mbox_type",	DT_MAGIC,R_NONE, UL &DefaultMagic, MUTT_MBOX },
   /*
   ** .pp
@@ -1903,6 +1971,15 @@ struct option_t MuttVars[] = {
   ** the previous methods are unavailable. If a method is available but
   ** authentication fails, mutt will not connect to the IMAP server.
   */
+  { "nntp_compress",	DT_BOOL, R_NONE, OPTNNTPCOMPRESS, 1 },
+  /*
+  ** .pp
+  ** When \fIset\fP, and the news server offers COMPRESS DEFLATE (RFC 8054),
+  ** Mutt compresses the connection once authenticated.  Overview data
+  ** shrinks several times over, which matters when catching up on a busy
+  ** newsgroup over a slow link.  Only available if Mutt was built with
+  ** zlib support.
+  */
   { "nntp_context",	DT_NUM, R_NONE, UL &NntpContext, 1000 },
   /*
   ** .pp
@@ -1924,6 +2001,15 @@ struct option_t MuttVars[] = {
   ** must be loaded when newsgroup is added to list (first time list
   ** loading or new newsgroup adding).
   */
+  { "nntp_pipeline_depth", DT_NUM, R_NONE, UL &NntpPipelineDepth, 10 },
+  /*
+  ** .pp
+  ** Controls how many overview and HEAD commands Mutt sends to the news
+  ** server before reading their answers.  Overview data for large ranges
+  ** of articles is requested in chunks, and with a deeper pipeline the
+  ** server never waits for the next request.  Set this variable to 0
+  ** for servers which don't handle pipelined commands.
+  */
   { "nntp_user",	DT_STR, R_NONE, UL &NntpUser, UL "" },
   /*
   ** .pp
@@ -4378,6 +4464,7 @@ const struct command_t Commands[] = {
 #endif
   { "source",		parse_source,		0 },
   { "spam",		parse_spam_list,	MUTT_SPAM },
+  { "stats",		mutt_parse_stats,	0 },
   { "nospam",		parse_spam_list,	MUTT_NOSPAM },
   { "shutdown-hook",	mutt_parse_hook,	MUTT_SHUTDOWNHOOK | MUTT_GLOBALHOOK },
   { "startup-hook",	mutt_parse_hook,	MUTT_STARTUPHOOK | MUTT_GLOBALHOOK },
@@ -4389,6 +4476,7 @@ const struct command_t Commands[] = {
   { "unauto_view",	parse_unlist,		UL &AutoViewList },
   { "unhdr_order",	parse_unlist,		UL &HeaderOrderList },
   { "unhook",		mutt_parse_unhook,	0 },
+  { "unstats",		mutt_parse_unstats,	0 },
   { "unignore",		parse_unignore,		0 },
   { "unlists",		parse_unlists,		0 },
   { "unmono",		mutt_parse_unmono,	0 },
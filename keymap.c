@@ -128,6 +128,87 @@ int LastKey;
 
 struct keymap_t *Keymaps[MENU_MAX];
 
+/* The keymap lists are indexed by a prefix tree, which km_dokey() follows
+ * key by key instead of walking the list, and by operation, for
+ * km_find_func().  The indexes of a menu are dropped by km_bind() and
+ * built again from the list when next needed. */
+struct km_node
+{
+  keycode_t key;
+  struct keymap_t *map;		/* binding of the sequence ending here */
+  struct km_node *child;	/* the next keys, sorted */
+  int nchild;
+};
+
+static struct km_node *KeyTrees[MENU_MAX];
+static struct keymap_t **KeyOps[MENU_MAX];
+
+static void km_free_node (struct km_node *node)
+{
+  int i;
+
+  for (i = 0; i < node->nchild; i++)
+    km_free_node (&node->child[i]);
+  FREE (&node->child);
+}
+
+static void km_free_index (int menu)
+{
+  if (KeyTrees[menu])
+  {
+    km_free_node (KeyTrees[menu]);
+    FREE (&KeyTrees[menu]);
+  }
+  FREE (&KeyOps[menu]);
+}
+
+static void km_build_index (int menu)
+{
+  struct keymap_t *map;
+  struct km_node *node;
+  int pos;
+
+  KeyTrees[menu] = safe_calloc (1, sizeof (struct km_node));
+  KeyOps[menu] = safe_calloc (OP_MAX, sizeof (struct keymap_t *));
+
+  for (map = Keymaps[menu]; map; map = map->next)
+  {
+    /* the list is sorted, so a new key always goes last */
+    for (node = KeyTrees[menu], pos = 0; pos < map->len; pos++)
+    {
+      if (!node->nchild || node->child[node->nchild - 1].key != map->keys[pos])
+      {
+	safe_realloc (&node->child, (node->nchild + 1) * sizeof (struct km_node));
+	memset (&node->child[node->nchild], 0, sizeof (struct km_node));
+	node->child[node->nchild++].key = map->keys[pos];
+      }
+      node = &node->child[node->nchild - 1];
+    }
+    if (!node->map)
+      node->map = map;
+
+    if (map->op >= 0 && map->op < OP_MAX && !KeyOps[menu][map->op])
+      KeyOps[menu][map->op] = map;
+  }
+}
+
+static struct km_node *km_next_node (struct km_node *node, int key)
+{
+  int lo = 0, hi = node->nchild - 1, mid;
+
+  while (lo <= hi)
+  {
+    mid = (lo + hi) / 2;
+    if (node->child[mid].key == key)
+      return &node->child[mid];
+    if (node->child[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return NULL;
+}
+
 static struct keymap_t *allocKeys (int len, keycode_t *keys)
 {
   struct keymap_t *p;
@@ -237,6 +318,8 @@ void km_bind (char *s, int menu, int op, char *macro, char *descr)
 
   len = parsekeys (s, buf, MAX_SEQ);
 
+  km_free_index (menu);
+
   map = allocKeys (len, buf);
   map->op = op;
   map->macro = safe_strdup (macro);
@@ -420,14 +503,20 @@ static int retry_generic (int menu, keycode_t *keys, int keyslen, int lastkey)
 int km_dokey (int menu)
 {
   event_t tmp;
-  struct keymap_t *map = Keymaps[menu];
+  struct keymap_t *map;
+  struct km_node *node;
+  keycode_t keys[MAX_SEQ];
   int pos = 0;
   int n = 0;
   int i;
 
-  if (!map)
+  if (!Keymaps[menu])
     return (retry_generic (menu, NULL, 0, 0));
 
+  if (!KeyTrees[menu])
+    km_build_index (menu);
+  node = KeyTrees[menu];
+
   FOREVER
   {
     i = Timeout > 0 ? Timeout : 60;
@@ -515,17 +604,11 @@ int km_dokey (int menu)
     }
 
     /* Nope. Business as usual */
-    while (LastKey > map->keys[pos])
-    {
-      if (pos > map->eq || !map->next)
-	return (retry_generic (menu, map->keys, pos, LastKey));
-      map = map->next;
-    }
-
-    if (LastKey != map->keys[pos])
-      return (retry_generic (menu, map->keys, pos, LastKey));
+    if (!(node = km_next_node (node, LastKey)))
+      return (retry_generic (menu, keys, pos, LastKey));
+    keys[pos++] = LastKey;
 
-    if (++pos == map->len)
+    if ((map = node->map))
     {
 
       if (map->op != OP_MACRO)
@@ -545,7 +628,7 @@ int km_dokey (int menu)
       }
 
       tokenize_push_macro_string (map->macro);
-      map = Keymaps[menu];
+      node = KeyTrees[menu];
       pos = 0;
     }
   }
@@ -619,6 +702,13 @@ struct keymap_t *km_find_func (int menu, int func)
 {
   struct keymap_t *map = Keymaps[menu];
 
+  if (func >= 0 && func < OP_MAX)
+  {
+    if (!KeyOps[menu])
+      km_build_index (menu);
+    return KeyOps[menu][func];
+  }
+
   for (; map; map = map->next)
     if (map->op == func)
       break;
@@ -76,6 +76,9 @@ void mutt_exit (int code)
   exit (code);
 }
 
+/* mutt_bench (bench.c) provides its own main() */
+#ifndef MUTT_BENCH
+
 static void mutt_usage (void)
 {
   puts (mutt_make_version ());
@@ -899,3 +902,5 @@ int main (int argc, char **argv)
 
   exit (0);
 }
+
+#endif /* MUTT_BENCH */
@@ -798,6 +798,90 @@ void mbox_reset_atime (CONTEXT *ctx, struct stat *st)
   utime (ctx->path, &utimebuf);
 }
 
+/* rewrite one status header in place, padded to its old length */
+static int mbox_write_status (FILE *fp, LOFF_T off, size_t len,
+                              const char *name, const char *flags)
+{
+  if (fseeko (fp, off, SEEK_SET) != 0 ||
+      fprintf (fp, "%s: %-*s\n", name,
+               (int) (len - mutt_strlen (name) - 3), flags) < 0)
+    return -1;
+  return 0;
+}
+
+/* Overwrite the Status: and X-Status: headers of a message whose only
+ * change is its flags.
+ *
+ * return values:
+ *	0	success
+ *	1	the new flags don't fit, the message must be rewritten
+ *	-1	failure
+ */
+static int mbox_sync_status (CONTEXT *ctx, HEADER *h)
+{
+  char buf[LONG_STRING];
+  char status[3], xstatus[3];
+  LOFF_T pos, soff = -1, xoff = -1;
+  size_t n, slen = 0, xlen = 0;
+  int bol = 1;
+
+  n = 0;
+  if (h->read)
+    status[n++] = 'R';
+  if (h->read || h->old)
+    status[n++] = 'O';
+  status[n] = 0;
+  n = 0;
+  if (h->replied)
+    xstatus[n++] = 'A';
+  if (h->flagged)
+    xstatus[n++] = 'F';
+  xstatus[n] = 0;
+
+  if (fseeko (ctx->fp, h->offset, SEEK_SET) != 0)
+    return -1;
+
+  /* find the existing headers; continuation lines never match as they
+   * start with white space */
+  for (pos = h->offset; pos < h->content->offset; pos += n)
+  {
+    if (fgets (buf, sizeof (buf), ctx->fp) == NULL)
+      return -1;
+    n = mutt_strlen (buf);
+    if (bol && !ascii_strncasecmp ("Status:", buf, 7))
+    {
+      if (soff != -1 || buf[n - 1] != '\n')
+        return 1;
+      soff = pos;
+      slen = n;
+    }
+    else if (bol && !ascii_strncasecmp ("X-Status:", buf, 9))
+    {
+      if (xoff != -1 || buf[n - 1] != '\n')
+        return 1;
+      xoff = pos;
+      xlen = n;
+    }
+    bol = buf[n - 1] == '\n';
+  }
+
+  /* each header needs room for its name, a space, the flags and a
+   * newline; a missing header may stay missing if no flag is set */
+  if ((soff == -1 && *status) ||
+      (soff != -1 && slen < sizeof ("Status: ") + mutt_strlen (status)) ||
+      (xoff == -1 && *xstatus) ||
+      (xoff != -1 && xlen < sizeof ("X-Status: ") + mutt_strlen (xstatus)))
+    return 1;
+
+  if ((soff != -1 &&
+       mbox_write_status (ctx->fp, soff, slen, "Status", status) != 0) ||
+      (xoff != -1 &&
+       mbox_write_status (ctx->fp, xoff, xlen, "X-Status", xstatus) != 0))
+    return -1;
+
+  return 0;
+}
+
 /* return values:
  *	0	success
  *	-1	failure
@@ -810,6 +894,8 @@ static int mbox_sync_mailbox (CONTEXT *ctx, int *index_hint)
   int rc = -1;
   int need_sort = 0; /* flag to resort mailbox if new mail arrives */
   int first = -1;	/* first message to be written */
+  int inplace = 0;	/* status headers were rewritten in place */
+  HEADER *h;
   LOFF_T offset;	/* location in mailbox to write changed messages */
   struct stat statbuf;
   struct m_update_t *newOffset = NULL;
@@ -860,6 +946,90 @@ static int mbox_sync_mailbox (CONTEXT *ctx, int *index_hint)
     /* fatal error */
     return (-1);
 
+  /* Save the state of this folder. */
+  if (stat (ctx->path, &statbuf) == -1)
+  {
+    mutt_perror (ctx->path);
+    mutt_sleep (5);
+    goto bail;
+  }
+
+  /* find the first deleted/changed message.  we save a lot of time by only
+   * rewriting the mailbox from the point where it has actually changed.
+   * up to there, messages whose flags changed can usually have their
+   * status headers overwritten in place.
+   */
+  for (i = 0; i < ctx->msgcount; i++)
+  {
+    h = ctx->hdrs[i];
+    if (h->deleted || h->attach_del || h->label_changed ||
+        h->env->irt_changed || h->env->refs_changed)
+      break;
+    if (!h->changed)
+      continue;
+    if ((j = mbox_sync_status (ctx, h)) > 0)
+      break;
+    if (j < 0)
+    {
+      mutt_perror (ctx->path);
+      mutt_sleep (5);
+      goto bail;
+    }
+    inplace = 1;
+  }
+  if (i == ctx->msgcount)
+  {
+    if (!inplace)
+    {
+      /* this means ctx->changed or ctx->deleted was set, but no
+       * messages were found to be changed or deleted.  This should
+       * never happen, is we presume it is a bug in mutt.
+       */
+      mutt_error _("sync: mbox modified, but no modified messages! (report this bug)");
+      mutt_sleep(5); /* the mutt_error /will/ get cleared! */
+      dprint(1, (debugfile, "mbox_sync_mailbox(): no modified messages.\n"));
+      goto bail;
+    }
+
+    /* every change was written in place */
+    if (fflush (ctx->fp) != 0)
+    {
+      mutt_perror (ctx->path);
+      mutt_sleep (5);
+      goto bail;
+    }
+    mbox_unlock_mailbox (ctx);
+    if (safe_fclose (&ctx->fp) != 0)
+    {
+      mutt_unblock_signals ();
+      mx_fastclose_mailbox (ctx);
+      mutt_perror (ctx->path);
+      mutt_sleep (5);
+      return (-1);
+    }
+    mbox_reset_atime (ctx, &statbuf);
+    if ((ctx->fp = fopen (ctx->path, "r")) == NULL)
+    {
+      mutt_unblock_signals ();
+      mx_fastclose_mailbox (ctx);
+      mutt_error _("Fatal error!  Could not reopen mailbox!");
+      return (-1);
+    }
+    mutt_unblock_signals ();
+
+    if (option(OPTCHECKMBOXSIZE))
+    {
+      tmp = mutt_find_mailbox (ctx->path);
+      if (tmp && tmp->new == 0)
+        mutt_update_mailbox (tmp);
+    }
+
+    return (0);
+  }
+
+  /* save the index of the first changed/deleted message */
+  first = i;
+
   /* Create a temporary file to write the new version of the mailbox in. */
   mutt_mktemp (tempfile, sizeof (tempfile));
   if ((i = open (tempfile, O_WRONLY | O_EXCL | O_CREAT, 0600)) == -1 ||
@@ -875,29 +1045,8 @@ static int mbox_sync_mailbox (CONTEXT *ctx, int *index_hint)
     goto bail;
   }
 
-  /* find the first deleted/changed message.  we save a lot of time by only
-   * rewriting the mailbox from the point where it has actually changed.
-   */
-  for (i = 0 ; i < ctx->msgcount && !ctx->hdrs[i]->deleted && 
-               !ctx->hdrs[i]->changed && !ctx->hdrs[i]->attach_del; i++)
-    ;
-  if (i == ctx->msgcount)
-  { 
-    /* this means ctx->changed or ctx->deleted was set, but no
-     * messages were found to be changed or deleted.  This should
-     * never happen, is we presume it is a bug in mutt.
-     */
-    mutt_error _("sync: mbox modified, but no modified messages! (report this bug)");
-    mutt_sleep(5); /* the mutt_error /will/ get cleared! */
-    dprint(1, (debugfile, "mbox_sync_mailbox(): no modified messages.\n"));
-    unlink (tempfile);
-    goto bail;
-  }
-
-    /* save the index of the first changed/deleted message */
-  first = i; 
   /* where to start overwriting */
-  offset = ctx->hdrs[i]->offset; 
+  offset = ctx->hdrs[first]->offset;
 
   /* the offset stored in the header does not include the MMDF_SEP, so make
    * sure we seek to the correct location
@@ -953,7 +1102,8 @@ static int mbox_sync_mailbox (CONTEXT *ctx, int *index_hint)
       newOffset[i - first].hdr = ftello (fp) + offset;
 
       if (mutt_copy_message (fp, ctx, ctx->hdrs[i], MUTT_CM_UPDATE,
-                             CH_FROM | CH_UPDATE | CH_UPDATE_LEN) != 0)
+                             CH_FROM | CH_UPDATE | CH_UPDATE_LEN |
+                             (option (OPTMBOXPADSTATUS) ? CH_PAD_STATUS : 0)) != 0)
       {
 	mutt_perror (tempfile);
 	mutt_sleep (5);
@@ -1004,15 +1154,6 @@ static int mbox_sync_mailbox (CONTEXT *ctx, int *index_hint)
   }
   fp = NULL;
 
-  /* Save the state of this folder. */
-  if (stat (ctx->path, &statbuf) == -1)
-  {
-    mutt_perror (ctx->path);
-    mutt_sleep (5);
-    unlink (tempfile);
-    goto bail;
-  }
-
   if ((fp = fopen (tempfile, "r")) == NULL)
   {
     mutt_unblock_signals ();
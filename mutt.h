@@ -423,6 +423,7 @@ enum
   OPTIMAPLSUB,
   OPTIMAPPASSIVE,
   OPTIMAPPEEK,
+  OPTIMAPSERVERSORT,
   OPTIMAPSERVERNOISE,
 #endif
 #if defined(USE_SSL)
@@ -450,6 +451,7 @@ enum
   OPTMAILDIRCHECKCUR,
   OPTMARKERS,
   OPTMARKOLD,
+  OPTMBOXPADSTATUS,
   OPTMENUSCROLL,	/* scroll menu instead of implicit next-page */
   OPTMENUMOVEOFF,	/* allow menu to scroll past last entry */
 #if defined(USE_IMAP) || defined(USE_POP)
@@ -569,6 +571,7 @@ enum
   OPTSAVEUNSUB,
   OPTLISTGROUP,
   OPTLOADDESC,
+  OPTNNTPCOMPRESS,
   OPTXCOMMENTTO,
 #endif
 
@@ -181,6 +181,9 @@ const char* crypt_get_fingerprint_or_id (char *p, const char **pphint,
 /* Check if a string contains a numerical key */
 short crypt_is_numerical_keyid (const char *s);
 
+/* State of the GnuPG keyring files, NULL if there are none */
+char *crypt_keyring_stamp (void);
+
 
 
 /*-- cryptglue.c --*/
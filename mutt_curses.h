@@ -80,6 +80,7 @@ event_t mutt_getch (void);
 
 void mutt_endwin (const char *);
 void mutt_flushinp (void);
+int mutt_input_pending (void);
 void mutt_refresh (void);
 void mutt_resize_screen (void);
 void mutt_unget_event (int, int);
@@ -29,6 +29,10 @@
 #include "url.h"
 #include "buffy.h"
 
+#if USE_HCACHE
+#include "hcache.h"
+#endif
+
 #include <dirent.h>
 #include <fcntl.h>
 #include <sys/file.h>
@@ -95,6 +99,21 @@ struct nm_hdrdata {
 	int magic;
 };
 
+/*
+ * query result waiting for its message file to be parsed
+ */
+struct nm_pending {
+	char *path;
+	struct nm_hdrdata *hdata;	/* tags and id, taken from the result */
+	HEADER *h;
+	char *newpath;			/* the file has moved to here */
+	ino_t inode;
+	int exists;
+};
+
+/* number of results parsed together, see flush_messages() */
+#define NM_PARSE_BATCH 1024
+
 /*
  * CONTEXT->data
  */
@@ -108,6 +127,17 @@ struct nm_ctxdata {
 
 	struct uri_tag *query_items;
 
+#if USE_HCACHE
+	header_cache_t *hc;	/* open while query results are read */
+#endif
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+	unsigned long revision;	/* database revision of the last read */
+	char *revision_uuid;
+#endif
+
+	struct nm_pending *pending;
+	int npending;
+
 	progress_t progress;
 	int oldmsgcount;
 	int ignmsgcount;	/* ingored messages */
@@ -251,6 +281,10 @@ static void free_ctxdata(struct nm_ctxdata *data)
 
 	FREE(&data->db_filename);
 	FREE(&data->db_query);
+	FREE(&data->pending);
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+	FREE(&data->revision_uuid);
+#endif
 	url_free_tags(data->query_items);
 	FREE(&data);
 }
@@ -689,9 +723,8 @@ static void append_str_item(char **str, const char *item, int sep)
 	memcpy(p, item, sz + 1);
 }
 
-static int update_header_tags(HEADER *h, notmuch_message_t *msg)
+static int update_hdrdata_tags(struct nm_hdrdata *data, notmuch_message_t *msg)
 {
-	struct nm_hdrdata *data = h->data;
 	notmuch_tags_t *tags;
 	char *tstr = NULL, *ttstr = NULL;
 	struct nm_hdrtag *tag_list = NULL, *tmp;
@@ -764,6 +797,11 @@ static int update_header_tags(HEADER *h, notmuch_message_t *msg)
 	return 0;
 }
 
+static int update_header_tags(HEADER *h, notmuch_message_t *msg)
+{
+	return update_hdrdata_tags(h->data, msg);
+}
+
 /*
  * set/update HEADER->path and HEADER->data->path
  */
@@ -841,35 +879,38 @@ static char *nm2mutt_message_id(const char *id)
 	return mid;
 }
 
-static int init_header(HEADER *h, const char *path, notmuch_message_t *msg)
+static struct nm_hdrdata *new_hdrdata(notmuch_message_t *msg)
 {
-	const char *id;
-
-	if (h->data)
-		return 0;
-
-	id = notmuch_message_get_message_id(msg);
-
-	h->data = safe_calloc(1, sizeof(struct nm_hdrdata));
-	h->free_cb = deinit_header;
+	struct nm_hdrdata *data = safe_calloc(1, sizeof(struct nm_hdrdata));
 
 	/*
 	 * Notmuch ensures that message Id exists (if not notmuch Notmuch will
 	 * generate an ID), so it's more safe than use mutt HEADER->env->id
 	 */
-	((struct nm_hdrdata *) h->data)->virtual_id = safe_strdup( id );
+	data->virtual_id = safe_strdup(notmuch_message_get_message_id(msg));
+
+	update_hdrdata_tags(data, msg);
+	return data;
+}
+
+/*
+ * attaches header data created by new_hdrdata() to the header, the data
+ * belongs to the header afterwards even on error
+ */
+static int attach_hdrdata(HEADER *h, const char *path, struct nm_hdrdata *data)
+{
+	h->data = data;
+	h->free_cb = deinit_header;
 
 	dprint(2, (debugfile, "nm: initialize header data: [hdr=%p, data=%p] (%s)\n",
-				h, h->data, id));
+				h, h->data, data->virtual_id));
 
 	if (!h->env->message_id)
-		h->env->message_id = nm2mutt_message_id( id );
+		h->env->message_id = nm2mutt_message_id(data->virtual_id);
 
 	if (update_message_path(h, path))
 		return -1;
 
-	update_header_tags(h, msg);
-
 	return 0;
 }
 
@@ -961,93 +1002,258 @@ static void nm_progress_update(CONTEXT *ctx, notmuch_query_t *q)
 					      - data->oldmsgcount, -1);
 }
 
-static void append_message(CONTEXT *ctx,
-			   notmuch_query_t *q,
-			   notmuch_message_t *msg,
-			   int dedup)
+#if USE_HCACHE
+/*
+ * The header cache is shared by all virtual folders of a database and
+ * keyed by message file path without the maildir flags, so that a tag
+ * or flag change doesn't invalidate the entry.
+ */
+static void nm_hcache_open(struct nm_ctxdata *data)
 {
-	char *newpath = NULL;
-	const char *path;
-	HEADER *h = NULL;
+	if (!data->hc)
+		data->hc = mutt_hcache_open(HeaderCache, get_db_filename(data), NULL);
+}
 
-	/* deduplicate */
-	if (dedup && get_mutt_header(ctx, msg)) {
-		get_ctxdata(ctx)->ignmsgcount++;
-		nm_progress_update(ctx, q);
-	        dprint(2, (debugfile, "nm: ignore id=%s, already in the context\n",
-					notmuch_message_get_message_id(msg)));
-		return;
-	}
+static void nm_hcache_close(struct nm_ctxdata *data)
+{
+	mutt_hcache_close(data->hc);
+	data->hc = NULL;
+}
 
-	path = get_message_last_filename(msg);
-	if (!path)
-		return;
+/*
+ * the cache key is the path without the maildir flags, so that a flag
+ * change doesn't lose the entry. mutt_hcache_fetch() and
+ * mutt_hcache_store() use the key up to its NUL, not keylen.
+ */
+static size_t nm_hcache_key(char *key, size_t keylen, const char *path)
+{
+	const char *p = strrchr(path, '/');
+	size_t len;
 
-	dprint(2, (debugfile, "nm: appending message, i=%d, id=%s, path=%s\n",
-				ctx->msgcount,
-				notmuch_message_get_message_id(msg),
-				path));
+	/* a directory name may contain ':' too */
+	p = strrchr(p ? p : path, ':');
+	len = p ? (size_t) (p - path) : mutt_strlen(path);
+
+	if (len >= keylen)
+		len = keylen - 1;
+	memcpy(key, path, len);
+	key[len] = '\0';
+	return len;
+}
+
+/*
+ * returns cached header of the message file, NULL if it isn't cached or
+ * the file has been modified since ($maildir_header_cache_verify)
+ */
+static HEADER *nm_hcache_fetch(struct nm_ctxdata *data, const char *path)
+{
+	struct timeval *when;
+	struct stat st;
+	char key[_POSIX_PATH_MAX];
+	void *hdata;
+	HEADER *h;
 
-	if (ctx->msgcount >= ctx->hdrmax) {
-		dprint(2, (debugfile, "nm: allocate mx memory\n"));
-		mx_alloc_memory(ctx);
+	hdata = mutt_hcache_fetch(data->hc, key,
+				  nm_hcache_key(key, sizeof(key), path));
+	if (!hdata)
+		return NULL;
+
+	when = (struct timeval *) hdata;
+	if (option(OPTHCACHEVERIFY) &&
+	    (stat(path, &st) != 0 || st.st_mtime > when->tv_sec)) {
+		FREE(&hdata);
+		return NULL;
 	}
-	if (access(path, F_OK) == 0)
-		h = maildir_parse_message(MUTT_MAILDIR, path, 0, NULL);
+
+	h = mutt_hcache_restore((unsigned char *) hdata);
+	FREE(&hdata);
+
+	/* the flags are in the file name */
+	h->trash = 0;
+	h->deleted = 0;
+	maildir_parse_flags(h, path);
+	return h;
+}
+#endif
+
+static int pending_cmp_inode(const void *a, const void *b)
+{
+	const struct nm_pending *pa = *(struct nm_pending * const *) a;
+	const struct nm_pending *pb = *(struct nm_pending * const *) b;
+
+	return pa->inode < pb->inode ? -1 : pa->inode > pb->inode ? 1 : 0;
+}
+
+static HEADER *parse_message(struct nm_pending *pd)
+{
+	HEADER *h = NULL;
+
+	if (pd->exists)
+		h = maildir_parse_message(MUTT_MAILDIR, pd->path, 0, NULL);
 	else {
 		/* maybe moved try find it... */
-		char *folder = get_folder_from_path(path);
+		char *folder = get_folder_from_path(pd->path);
 
 		if (folder) {
-			FILE *f = maildir_open_find_message(folder, path, &newpath);
+			FILE *f = maildir_open_find_message(folder, pd->path,
+							    &pd->newpath);
 			if (f) {
-				h = maildir_parse_stream(MUTT_MAILDIR, f, newpath, 0, NULL);
+				h = maildir_parse_stream(MUTT_MAILDIR, f,
+							 pd->newpath, 0, NULL);
 				fclose(f);
 
 				dprint(1, (debugfile, "nm: not up-to-date: %s -> %s\n",
-							path, newpath));
+							pd->path, pd->newpath));
 			}
 		}
 		FREE(&folder);
 	}
+	return h;
+}
 
-	if (!h) {
-		dprint(1, (debugfile, "nm: failed to parse message: %s\n", path));
-		goto done;
+/*
+ * Parses the message files of the queued query results and appends them
+ * to the context in query order.  Like maildir_delayed_parsing() does,
+ * the files missing in the header cache are read in inode order, which
+ * keeps the disk from seeking back and forth across the maildirs the
+ * results come from.
+ */
+static void flush_messages(CONTEXT *ctx, notmuch_query_t *q)
+{
+	struct nm_ctxdata *data = get_ctxdata(ctx);
+	struct nm_pending **order;
+	struct stat st;
+	int i, n;
+
+	if (!data->npending)
+		return;
+
+	dprint(2, (debugfile, "nm: parsing %d messages\n", data->npending));
+
+	order = safe_malloc(data->npending * sizeof(struct nm_pending *));
+	for (i = 0, n = 0; i < data->npending; i++) {
+		struct nm_pending *pd = &data->pending[i];
+
+#if USE_HCACHE
+		pd->h = nm_hcache_fetch(data, pd->path);
+		if (pd->h)
+			continue;
+#endif
+		if (stat(pd->path, &st) == 0) {
+			pd->exists = 1;
+			pd->inode = st.st_ino;
+		}
+		order[n++] = pd;
 	}
-	if (init_header(h, newpath ? newpath : path, msg) != 0) {
-		mutt_free_header(&h);
-		dprint(1, (debugfile, "nm: failed to append header!\n"));
-		goto done;
+
+	qsort(order, n, sizeof(struct nm_pending *), pending_cmp_inode);
+
+	for (i = 0; i < n; i++) {
+		struct nm_pending *pd = order[i];
+
+		pd->h = parse_message(pd);
+#if USE_HCACHE
+		if (pd->h) {
+			const char *fn = pd->newpath ? pd->newpath : pd->path;
+			char key[_POSIX_PATH_MAX];
+
+			mutt_hcache_store(data->hc, key,
+					  nm_hcache_key(key, sizeof(key), fn),
+					  pd->h, 0);
+		}
+#endif
 	}
+	FREE(&order);
 
-	h->active = 1;
-	h->index = ctx->msgcount;
-	ctx->size += h->content->length
-		   + h->content->offset
-		   - h->content->hdr_offset;
-	ctx->hdrs[ctx->msgcount] = h;
-	ctx->msgcount++;
-
-	if (newpath) {
-		/* remember that file has been moved -- nm_sync_mailbox() will update the DB */
-		struct nm_hdrdata *hd = (struct nm_hdrdata *) h->data;
-
-		if (hd) {
-			dprint(1, (debugfile, "nm: remember obsolete path: %s\n", path));
-			hd->oldpath = safe_strdup(path);
+	for (i = 0; i < data->npending; i++) {
+		struct nm_pending *pd = &data->pending[i];
+		HEADER *h = pd->h;
+
+		if (!h) {
+			dprint(1, (debugfile, "nm: failed to parse message: %s\n",
+						pd->path));
+			free_hdrdata(pd->hdata);
+			goto next;
+		}
+		if (attach_hdrdata(h, pd->newpath ? pd->newpath : pd->path,
+				   pd->hdata) != 0) {
+			mutt_free_header(&h);
+			dprint(1, (debugfile, "nm: failed to append header!\n"));
+			goto next;
 		}
+
+		if (ctx->msgcount >= ctx->hdrmax) {
+			dprint(2, (debugfile, "nm: allocate mx memory\n"));
+			mx_alloc_memory(ctx);
+		}
+
+		h->active = 1;
+		h->index = ctx->msgcount;
+		ctx->size += h->content->length
+			   + h->content->offset
+			   - h->content->hdr_offset;
+		ctx->hdrs[ctx->msgcount] = h;
+		ctx->msgcount++;
+
+		if (pd->newpath) {
+			/* remember that file has been moved -- nm_sync_mailbox() will update the DB */
+			struct nm_hdrdata *hd = (struct nm_hdrdata *) h->data;
+
+			dprint(1, (debugfile, "nm: remember obsolete path: %s\n", pd->path));
+			hd->oldpath = safe_strdup(pd->path);
+		}
+		nm_progress_update(ctx, q);
+next:
+		FREE(&pd->path);
+		FREE(&pd->newpath);
 	}
-	nm_progress_update(ctx, q);
-done:
-	FREE(&newpath);
+
+	memset(data->pending, 0, data->npending * sizeof(struct nm_pending));
+	data->npending = 0;
 }
 
 /*
- * add all the replies to a given messages into the display.
- * Careful, this calls itself recursively to make sure we get
- * everything.
+ * queues a query result for flush_messages(), which does the expensive
+ * part of appending it to the context
  */
+static void append_message(CONTEXT *ctx,
+			   notmuch_query_t *q,
+			   notmuch_message_t *msg,
+			   int dedup)
+{
+	struct nm_ctxdata *data = get_ctxdata(ctx);
+	struct nm_pending *pd;
+	const char *path;
+
+	/* deduplicate */
+	if (dedup && get_mutt_header(ctx, msg)) {
+		data->ignmsgcount++;
+		nm_progress_update(ctx, q);
+	        dprint(2, (debugfile, "nm: ignore id=%s, already in the context\n",
+					notmuch_message_get_message_id(msg)));
+		return;
+	}
+
+	path = get_message_last_filename(msg);
+	if (!path)
+		return;
+
+	dprint(2, (debugfile, "nm: appending message, i=%d, id=%s, path=%s\n",
+				ctx->msgcount + data->npending,
+				notmuch_message_get_message_id(msg),
+				path));
+
+	if (!data->pending)
+		data->pending = safe_calloc(NM_PARSE_BATCH, sizeof(struct nm_pending));
+
+	pd = &data->pending[data->npending++];
+	pd->path = safe_strdup(path);
+	pd->hdata = new_hdrdata(msg);
+
+	if (data->npending == NM_PARSE_BATCH)
+		flush_messages(ctx, q);
+}
+
 static void append_replies(CONTEXT *ctx,
 			   notmuch_query_t *q,
 			   notmuch_message_t *top,
@@ -1108,13 +1314,14 @@ static void read_mesgs_query(CONTEXT *ctx, notmuch_query_t *q, int dedup)
 #endif
 
 	for (; notmuch_messages_valid(msgs) &&
-		(limit == 0 || ctx->msgcount < limit);
+		(limit == 0 || ctx->msgcount + data->npending < limit);
 	     notmuch_messages_move_to_next(msgs)) {
 
 		notmuch_message_t *m = notmuch_messages_get(msgs);
 		append_message(ctx, q, m, dedup);
 		notmuch_message_destroy(m);
 	}
+	flush_messages(ctx, q);
 }
 
 static void read_threads_query(CONTEXT *ctx, notmuch_query_t *q, int dedup, int limit)
@@ -1133,15 +1340,29 @@ static void read_threads_query(CONTEXT *ctx, notmuch_query_t *q, int dedup, int
 #endif
 
 	for (; notmuch_threads_valid(threads) &&
-		(limit == 0 || ctx->msgcount < limit);
+		(limit == 0 || ctx->msgcount + data->npending < limit);
 	     notmuch_threads_move_to_next(threads)) {
 
 		notmuch_thread_t *thread = notmuch_threads_get(threads);
 		append_thread(ctx, q, thread, dedup);
 		notmuch_thread_destroy(thread);
 	}
+	flush_messages(ctx, q);
 }
 
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+/*
+ * remembers the database revision the context is up to date with
+ */
+static void save_revision(struct nm_ctxdata *data)
+{
+	const char *uuid = NULL;
+
+	data->revision = notmuch_database_get_revision(data->db, &uuid);
+	mutt_str_replace(&data->revision_uuid, uuid);
+}
+#endif
+
 int nm_read_query(CONTEXT *ctx)
 {
 	notmuch_query_t *q;
@@ -1162,6 +1383,12 @@ int nm_read_query(CONTEXT *ctx)
 
 	q = get_query(data, FALSE);
 	if (q) {
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+		save_revision(data);
+#endif
+#if USE_HCACHE
+		nm_hcache_open(data);
+#endif
 		switch(get_query_type(data)) {
 		case NM_QUERY_TYPE_MESGS:
 			read_mesgs_query(ctx, q, 0);
@@ -1171,6 +1398,9 @@ int nm_read_query(CONTEXT *ctx)
 			break;
 		}
 		notmuch_query_destroy(q);
+#if USE_HCACHE
+		nm_hcache_close(data);
+#endif
 		rc = 0;
 
 	}
@@ -1220,7 +1450,13 @@ int nm_read_entire_thread(CONTEXT *ctx, HEADER *h)
 	apply_exclude_tags(q);
 	notmuch_query_set_sort(q, NOTMUCH_SORT_NEWEST_FIRST);
 
+#if USE_HCACHE
+	nm_hcache_open(data);
+#endif
 	read_threads_query(ctx, q, 1, 0);
+#if USE_HCACHE
+	nm_hcache_close(data);
+#endif
 	ctx->mtime = time(NULL);
 	rc = 0;
 
@@ -1699,9 +1935,101 @@ static unsigned count_query(notmuch_database_t *db, const char *qstr)
 	return res;
 }
 
+/*
+ * The counts of the virtual mailboxes share one read-only database
+ * handle, which is reopened only when the database has been written to.
+ * The counts are cached and queried again only when the revision of the
+ * reopened database has moved, so a buffy check over many unchanged
+ * vfolders neither opens the database nor runs any query.
+ */
+struct nm_count {
+	char *path;
+	int all;
+	int new;
+	unsigned gen;		/* CountGen the counts were computed at */
+	struct nm_count *next;
+};
+
+static notmuch_database_t *CountDb;
+static char *CountDbFilename;
+static time_t CountDbMtime;
+static time_t CountDbOpened;
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+static unsigned long CountRevision;
+static char *CountRevisionUuid;
+#endif
+static char *CountOptions;
+static unsigned CountGen;	/* bumped whenever cached counts get stale */
+static struct nm_count *Counts;
+
+static notmuch_database_t *get_count_db(const char *filename)
+{
+	char path[_POSIX_PATH_MAX];
+	char *opts = NULL;
+	struct stat st;
+	time_t mtime = 0;
+
+	snprintf(path, sizeof(path), "%s/.notmuch/xapian", filename);
+	if (stat(path, &st) == 0)
+		mtime = st.st_mtime;
+
+	/* a write within the second the handle was opened in may not be
+	 * visible to it, so such a handle is never trusted */
+	if (!CountDb || mutt_strcmp(filename, CountDbFilename) != 0 ||
+	    !mtime || mtime != CountDbMtime || mtime >= CountDbOpened) {
+		if (CountDb) {
+#ifdef NOTMUCH_API_3
+			notmuch_database_destroy(CountDb);
+#else
+			notmuch_database_close(CountDb);
+#endif
+			dprint(1, (debugfile, "nm: count close DB\n"));
+		}
+
+		/* don't be verbose about connection, as we're called from
+		 * sidebar/buffy very often */
+		CountDbOpened = time(NULL);
+		CountDb = do_database_open(filename, FALSE, FALSE);
+		if (!CountDb)
+			return NULL;
+		CountDbMtime = mtime;
+
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+		{
+			const char *uuid = NULL;
+			unsigned long rev = notmuch_database_get_revision(CountDb, &uuid);
+
+			if (rev != CountRevision ||
+			    mutt_strcmp(uuid, CountRevisionUuid) != 0 ||
+			    mutt_strcmp(filename, CountDbFilename) != 0) {
+				dprint(2, (debugfile, "nm: count revision %lu\n", rev));
+				CountRevision = rev;
+				mutt_str_replace(&CountRevisionUuid, uuid);
+				CountGen++;
+			}
+		}
+#else
+		CountGen++;
+#endif
+		mutt_str_replace(&CountDbFilename, filename);
+	}
+
+	/* the counts depend on these options as well */
+	safe_asprintf(&opts, "%s\n%s", NONULL(NotmuchExcludeTags),
+			NONULL(NotmuchUnreadTag));
+	if (mutt_strcmp(opts, CountOptions) != 0) {
+		mutt_str_replace(&CountOptions, opts);
+		CountGen++;
+	}
+	FREE(&opts);
+
+	return CountDb;
+}
+
 int nm_nonctx_get_count(char *path, int *all, int *new)
 {
 	struct uri_tag *query_items = NULL, *item;
+	struct nm_count *cnt;
 	char *db_filename = NULL, *db_query = NULL;
 	notmuch_database_t *db = NULL;
 	int rc = -1, dflt = 0;
@@ -1735,37 +2063,47 @@ int nm_nonctx_get_count(char *path, int *all, int *new)
 			db_filename = Maildir;
 		dflt = 1;
 	}
+	if (!db_filename)
+		goto done;
 
-	/* don't be verbose about connection, as we're called from
-	 * sidebar/buffy very often */
-	db = do_database_open(db_filename, FALSE, FALSE);
+	db = get_count_db(db_filename);
 	if (!db)
 		goto done;
 
-	/* all emails */
-	if (all)
-		*all = count_query(db, db_query);
+	for (cnt = Counts; cnt; cnt = cnt->next)
+		if (strcmp(cnt->path, path) == 0)
+			break;
+	if (!cnt) {
+		cnt = safe_calloc(1, sizeof(struct nm_count));
+		cnt->path = safe_strdup(path);
+		cnt->gen = CountGen - 1;
+		cnt->next = Counts;
+		Counts = cnt;
+	}
 
-	/* new messages */
-	if (new) {
+	if (cnt->gen != CountGen) {
 		char *qstr;
 
+		/* all emails */
+		cnt->all = count_query(db, db_query);
+
+		/* new messages */
 		safe_asprintf(&qstr, "( %s ) tag:%s",
 				db_query, NotmuchUnreadTag);
-		*new = count_query(db, qstr);
+		cnt->new = count_query(db, qstr);
 		FREE(&qstr);
-	}
+
+		cnt->gen = CountGen;
+	} else
+		dprint(2, (debugfile, "nm: count unchanged\n"));
+
+	if (all)
+		*all = cnt->all;
+	if (new)
+		*new = cnt->new;
 
 	rc = 0;
 done:
-	if (db) {
-#ifdef NOTMUCH_API_3
-		notmuch_database_destroy(db);
-#else
-		notmuch_database_close(db);
-#endif
-		dprint(1, (debugfile, "nm: count close DB\n"));
-	}
 	if (!dflt)
 		FREE(&db_filename);
 	url_free_tags(query_items);
@@ -1835,13 +2173,155 @@ static HEADER *get_mutt_header(CONTEXT *ctx, notmuch_message_t *msg)
 	return h;
 }
 
+/*
+ * merges the current state of a message into its header in the context,
+ * returns 0 if the tags of the message have changed
+ */
+static int merge_header(CONTEXT *ctx, HEADER *h, notmuch_message_t *m)
+{
+	char old[_POSIX_PATH_MAX];
+	const char *new;
+
+	h->active = 1;
+
+	/* check to see if the message has moved to a different
+	 * subdirectory.  If so, update the associated filename.
+	 */
+	new = get_message_last_filename(m);
+	nm_header_get_fullpath(h, old, sizeof(old));
+
+	if (mutt_strcmp(old, new) != 0)
+		update_message_path(h, new);
+
+	if (!h->changed) {
+		/* if the user hasn't modified the flags on
+		 * this message, update the flags we just
+		 * detected.
+		 */
+		HEADER tmp;
+		memset(&tmp, 0, sizeof(tmp));
+		maildir_parse_flags(&tmp, new);
+		maildir_update_flags(ctx, h, &tmp);
+	}
+
+	return update_header_tags(h, m);
+}
+
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+/*
+ * Patches the context with the messages modified since the last read
+ * or check, found by their "lastmod:" revision.  Returns -1 if the whole
+ * query has to be read again instead: the database has been replaced,
+ * messages have been removed from it, or the query is limited or reads
+ * threads, so that an unmodified message can enter or leave the folder.
+ */
+static int check_modified(CONTEXT *ctx, int *new_flags)
+{
+	struct nm_ctxdata *data = get_ctxdata(ctx);
+	notmuch_database_t *db;
+	notmuch_query_t *q;
+	notmuch_messages_t *msgs;
+	const char *uuid = NULL;
+	unsigned long revision;
+	unsigned count;
+	char *qstr = NULL;
+	char range[STRING];
+	int i, active, rc = -1;
+
+	if (!data->revision_uuid || get_limit(data) ||
+	    get_query_type(data) != NM_QUERY_TYPE_MESGS)
+		return -1;
+	if (!(db = get_db(data, FALSE)) || !get_query_string(data))
+		return -1;
+
+	revision = notmuch_database_get_revision(db, &uuid);
+	if (mutt_strcmp(uuid, data->revision_uuid) != 0)
+		return -1;
+	if (revision == data->revision)
+		return 0;
+
+	dprint(1, (debugfile, "nm: checking revisions %lu..%lu\n",
+				data->revision + 1, revision));
+	snprintf(range, sizeof(range), "lastmod:%lu..%lu", data->revision + 1,
+			revision);
+
+	/* modified messages leave the context... */
+	q = notmuch_query_create(db, range);
+	if (!q)
+		return -1;
+	if (notmuch_query_search_messages_st (q, &msgs) != NOTMUCH_STATUS_SUCCESS)
+		goto done;
+	for (; notmuch_messages_valid(msgs); notmuch_messages_move_to_next(msgs)) {
+		notmuch_message_t *m = notmuch_messages_get(msgs);
+		HEADER *h = get_mutt_header(ctx, m);
+
+		if (h)
+			h->active = 0;
+		notmuch_message_destroy(m);
+	}
+	notmuch_query_destroy(q);
+
+	/* ...unless they still match the query */
+	append_str_item(&qstr, range, 0);
+	append_str_item(&qstr, "and (", ' ');
+	append_str_item(&qstr, get_query_string(data), 0);
+	append_str_item(&qstr, ")", 0);
+	q = notmuch_query_create(db, qstr);
+	FREE(&qstr);
+	if (!q)
+		return -1;
+	apply_exclude_tags(q);
+	notmuch_query_set_sort(q, NOTMUCH_SORT_NEWEST_FIRST);
+	if (notmuch_query_search_messages_st (q, &msgs) != NOTMUCH_STATUS_SUCCESS)
+		goto done;
+	for (; notmuch_messages_valid(msgs); notmuch_messages_move_to_next(msgs)) {
+		notmuch_message_t *m = notmuch_messages_get(msgs);
+		HEADER *h = get_mutt_header(ctx, m);
+
+		if (!h)
+			append_message(ctx, NULL, m, 0);
+		else if (merge_header(ctx, h, m) == 0)
+			(*new_flags)++;
+		notmuch_message_destroy(m);
+	}
+	flush_messages(ctx, NULL);
+	notmuch_query_destroy(q);
+
+	/* make the new messages known to get_mutt_header() */
+	if (ctx->msgcount > data->oldmsgcount) {
+		mx_update_context(ctx, ctx->msgcount - data->oldmsgcount);
+		data->oldmsgcount = ctx->msgcount;
+	}
+	data->revision = revision;
+
+	/* messages removed from the database have no revision to find them
+	 * by, but they change the number of matching messages */
+	q = get_query(data, FALSE);
+	if (!q)
+		return -1;
+	if (notmuch_query_count_messages_st (q, &count) != NOTMUCH_STATUS_SUCCESS)
+		goto done;
+	for (i = 0, active = 0; i < ctx->msgcount; i++)
+		if (ctx->hdrs[i]->active)
+			active++;
+	if (active == count)
+		rc = 0;
+	else
+		dprint(1, (debugfile, "nm: %d messages in context, %u in query\n",
+					active, count));
+done:
+	notmuch_query_destroy(q);
+	return rc;
+}
+#endif
+
 static int nm_check_database(CONTEXT *ctx, int *index_hint)
 {
 	struct nm_ctxdata *data = get_ctxdata(ctx);
 	time_t mtime = 0;
-	notmuch_query_t *q;
+	notmuch_query_t *q = NULL;
 	notmuch_messages_t *msgs;
-	int i, limit, occult = 0, new_flags = 0;
+	int i, limit, oldmsgcount, occult = 0, new_flags = 0;
 
 	if (!data || get_database_mtime(data, &mtime) != 0)
 		return -1;
@@ -1853,16 +2333,26 @@ static int nm_check_database(CONTEXT *ctx, int *index_hint)
 
 	dprint(1, (debugfile, "nm: checking (db=%d ctx=%d)\n", mtime, ctx->mtime));
 
+	oldmsgcount = data->oldmsgcount = ctx->msgcount;
+	data->noprogress = 1;
+#if USE_HCACHE
+	nm_hcache_open(data);
+#endif
+
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+	if (check_modified(ctx, &new_flags) == 0)
+		goto update;
+	new_flags = 0;
+#endif
+
 	q = get_query(data, FALSE);
 	if (!q)
 		goto done;
+#if LIBNOTMUCH_CHECK_VERSION(4,3,0)
+	save_revision(data);
+#endif
 
 	dprint(1, (debugfile, "nm: start checking (count=%d)\n", ctx->msgcount));
-	data->oldmsgcount = ctx->msgcount;
-	data->noprogress = 1;
-
-	for (i = 0; i < ctx->msgcount; i++)
-		ctx->hdrs[i]->active = 0;
 
 	limit = get_limit(data);
 
@@ -1873,13 +2363,13 @@ static int nm_check_database(CONTEXT *ctx, int *index_hint)
 	msgs = notmuch_query_search_messages(q);
 #endif
 
+	for (i = 0; i < ctx->msgcount; i++)
+		ctx->hdrs[i]->active = 0;
+
 	for (i = 0;
 	     notmuch_messages_valid(msgs) && (limit == 0 || i < limit);
 	     notmuch_messages_move_to_next(msgs), i++) {
 
-		char old[_POSIX_PATH_MAX];
-		const char *new;
-
 		notmuch_message_t *m = notmuch_messages_get(msgs);
 		HEADER *h = get_mutt_header(ctx, m);
 
@@ -1891,34 +2381,14 @@ static int nm_check_database(CONTEXT *ctx, int *index_hint)
 		}
 
 		/* message already exists, merge flags */
-		h->active = 1;
-
-		/* check to see if the message has moved to a different
-		 * subdirectory.  If so, update the associated filename.
-		 */
-		new = get_message_last_filename(m);
-		nm_header_get_fullpath(h, old, sizeof(old));
-
-		if (mutt_strcmp(old, new) != 0)
-			update_message_path(h, new);
-
-		if (!h->changed) {
-			/* if the user hasn't modified the flags on
-			 * this message, update the flags we just
-			 * detected.
-			 */
-			HEADER tmp;
-			memset(&tmp, 0, sizeof(tmp));
-			maildir_parse_flags(&tmp, new);
-			maildir_update_flags(ctx, h, &tmp);
-		}
-
-		if (update_header_tags(h, m) == 0)
+		if (merge_header(ctx, h, m) == 0)
 			new_flags++;
 
 		notmuch_message_destroy(m);
 	}
+	flush_messages(ctx, NULL);
 
+update:
 	for (i = 0; i < ctx->msgcount; i++) {
 		if (ctx->hdrs[i]->active == 0) {
 			occult = 1;
@@ -1931,6 +2401,9 @@ static int nm_check_database(CONTEXT *ctx, int *index_hint)
 done:
 	if (q)
 		notmuch_query_destroy(q);
+#if USE_HCACHE
+	nm_hcache_close(data);
+#endif
 
 	if (!is_longrun(data))
 		release_db(data);
@@ -1941,7 +2414,7 @@ done:
 				ctx->msgcount, new_flags, occult));
 
 	return occult ? MUTT_REOPENED :
-	       ctx->msgcount > data->oldmsgcount ? MUTT_NEW_MAIL :
+	       ctx->msgcount > oldmsgcount ? MUTT_NEW_MAIL :
 	       new_flags ? MUTT_FLAGS : 0;
 }
 
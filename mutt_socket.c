@@ -30,6 +30,7 @@
 #endif
 
 #include "mutt_idna.h"
+#include "stats.h"
 
 #include <unistd.h>
 #include <netinet/in.h>
@@ -89,6 +90,7 @@ int mutt_socket_close (CONNECTION* conn)
 int mutt_socket_read (CONNECTION* conn, char* buf, size_t len)
 {
   int rc;
+  stat_time_t t;
 
   if (conn->fd < 0)
   {
@@ -96,7 +98,10 @@ int mutt_socket_read (CONNECTION* conn, char* buf, size_t len)
     return -1;
   }
 
+  t = mutt_stats_now ();
   rc = conn->conn_read (conn, buf, len);
+  mutt_stats_add (STAT_NET_READ, t);
+  mutt_stats_bytes (STAT_NET_READ, rc);
   /* EOF */
   if (rc == 0)
   {
@@ -113,6 +118,7 @@ int mutt_socket_write_d (CONNECTION *conn, const char *buf, int len, int dbg)
 {
   int rc;
   int sent = 0;
+  stat_time_t t;
 
   dprint (dbg, (debugfile,"%d> %s", conn->fd, buf));
 
@@ -125,6 +131,7 @@ int mutt_socket_write_d (CONNECTION *conn, const char *buf, int len, int dbg)
   if (len < 0)
     len = mutt_strlen (buf);
   
+  t = mutt_stats_now ();
   while (sent < len)
   {
     if ((rc = conn->conn_write (conn, buf + sent, len - sent)) < 0)
@@ -144,6 +151,8 @@ int mutt_socket_write_d (CONNECTION *conn, const char *buf, int len, int dbg)
     
     sent += rc;
   }
+  mutt_stats_add (STAT_NET_WRITE, t);
+  mutt_stats_bytes (STAT_NET_WRITE, sent);
 
   return sent;
 }
@@ -169,7 +178,13 @@ int mutt_socket_readchar (CONNECTION *conn, char *c)
   if (conn->bufpos >= conn->available)
   {
     if (conn->fd >= 0)
+    {
+      stat_time_t t = mutt_stats_now ();
+
       conn->available = conn->conn_read (conn, conn->inbuf, sizeof (conn->inbuf));
+      mutt_stats_add (STAT_NET_READ, t);
+      mutt_stats_bytes (STAT_NET_READ, conn->available);
+    }
     else
     {
       dprint (1, (debugfile, "mutt_socket_readchar: attempt to read from closed connection.\n"));
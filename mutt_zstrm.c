@@ -0,0 +1,214 @@
+/*
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/* DEFLATE compression layer for connections (RFC 4978, RFC 8054).
+ * It stacks on top of the transport the same way the SASL protection
+ * layer does (see mutt_sasl.c): the connection methods are replaced by
+ * wrappers which keep the underlying ones and sockdata, and the close
+ * wrapper restores them. */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mutt_socket.h"
+#include "mutt_zstrm.h"
+
+#include <zlib.h>
+
+#define ZSTRM_BUFSIZE 8192
+
+typedef struct
+{
+  z_stream z;
+  char *buf;
+  unsigned int len;
+  unsigned int pending : 1;	/* output buffer was filled, call inflate again */
+  unsigned int eof : 1;
+} ZSTRM_DIR;
+
+typedef struct
+{
+  ZSTRM_DIR read;
+  ZSTRM_DIR write;
+
+  /* underlying socket data and methods */
+  void *sockdata;
+  int (*zstrm_close) (CONNECTION *conn);
+  int (*zstrm_read) (CONNECTION *conn, char *buf, size_t len);
+  int (*zstrm_write) (CONNECTION *conn, const char *buf, size_t count);
+  int (*zstrm_poll) (CONNECTION *conn);
+} ZSTRM_DATA;
+
+/* zstrm_close: restore the underlying methods, release the streams and
+ *   close the connection */
+static int zstrm_close (CONNECTION *conn)
+{
+  ZSTRM_DATA *zdata = conn->sockdata;
+
+  conn->sockdata = zdata->sockdata;
+  conn->conn_close = zdata->zstrm_close;
+  conn->conn_read = zdata->zstrm_read;
+  conn->conn_write = zdata->zstrm_write;
+  conn->conn_poll = zdata->zstrm_poll;
+
+  inflateEnd (&zdata->read.z);
+  deflateEnd (&zdata->write.z);
+  FREE (&zdata->read.buf);
+  FREE (&zdata->write.buf);
+  FREE (&zdata);
+
+  return (conn->conn_close) (conn);
+}
+
+/* zstrm_read: inflate into buf whatever the underlying connection has
+ *   for us. Never returns 0 unless the stream or the connection ended,
+ *   since callers take that for a closed connection. */
+static int zstrm_read (CONNECTION *conn, char *buf, size_t len)
+{
+  ZSTRM_DATA *zdata = conn->sockdata;
+  int rc, zrc;
+
+  while (!zdata->read.eof)
+  {
+    if (zdata->read.z.avail_in || zdata->read.pending)
+    {
+      zdata->read.z.next_out = (Bytef *) buf;
+      zdata->read.z.avail_out = len;
+      zrc = inflate (&zdata->read.z, Z_SYNC_FLUSH);
+      switch (zrc)
+      {
+	case Z_OK:
+	case Z_BUF_ERROR:
+	  break;
+	case Z_STREAM_END:
+	  zdata->read.eof = 1;
+	  break;
+	default:
+	  dprint (1, (debugfile, "zstrm_read: inflate failed: %d\n", zrc));
+	  return -1;
+      }
+      zdata->read.pending = zdata->read.z.avail_out == 0;
+
+      rc = len - zdata->read.z.avail_out;
+      if (rc > 0)
+	return rc;
+      continue;
+    }
+
+    /* nothing left to inflate, get more from the connection */
+    conn->sockdata = zdata->sockdata;
+    rc = (zdata->zstrm_read) (conn, zdata->read.buf, zdata->read.len);
+    conn->sockdata = zdata;
+    if (rc <= 0)
+      return rc;
+
+    zdata->read.z.next_in = (Bytef *) zdata->read.buf;
+    zdata->read.z.avail_in = rc;
+  }
+
+  return 0;
+}
+
+/* zstrm_write: deflate buf and flush it to the connection, so that the
+ *   server sees a complete command without waiting for more */
+static int zstrm_write (CONNECTION *conn, const char *buf, size_t count)
+{
+  ZSTRM_DATA *zdata = conn->sockdata;
+  int rc = -1, zrc;
+  char *p;
+  int n;
+
+  zdata->write.z.next_in = (Bytef *) buf;
+  zdata->write.z.avail_in = count;
+
+  conn->sockdata = zdata->sockdata;
+  do
+  {
+    zdata->write.z.next_out = (Bytef *) zdata->write.buf;
+    zdata->write.z.avail_out = zdata->write.len;
+    zrc = deflate (&zdata->write.z, Z_SYNC_FLUSH);
+    if (zrc != Z_OK && zrc != Z_BUF_ERROR)
+    {
+      dprint (1, (debugfile, "zstrm_write: deflate failed: %d\n", zrc));
+      rc = -1;
+      goto out;
+    }
+
+    p = zdata->write.buf;
+    n = zdata->write.len - zdata->write.z.avail_out;
+    while (n > 0)
+    {
+      if ((rc = (zdata->zstrm_write) (conn, p, n)) < 0)
+	goto out;
+      p += rc;
+      n -= rc;
+    }
+  }
+  while (zdata->write.z.avail_out == 0);
+  rc = count;
+
+out:
+  conn->sockdata = zdata;
+  return rc;
+}
+
+static int zstrm_poll (CONNECTION *conn)
+{
+  ZSTRM_DATA *zdata = conn->sockdata;
+  int rc;
+
+  if (zdata->read.z.avail_in || zdata->read.pending)
+    return 1;
+
+  conn->sockdata = zdata->sockdata;
+  rc = (zdata->zstrm_poll) (conn);
+  conn->sockdata = zdata;
+
+  return rc;
+}
+
+/* mutt_zstrm_wrap_conn: compress everything sent and received on conn
+ *   from now on, until it is closed. Call it right after the server
+ *   has accepted COMPRESS DEFLATE. */
+void mutt_zstrm_wrap_conn (CONNECTION *conn)
+{
+  ZSTRM_DATA *zdata = safe_calloc (1, sizeof (ZSTRM_DATA));
+
+  /* raw deflate streams, as both RFCs ask for */
+  inflateInit2 (&zdata->read.z, -15);
+  deflateInit2 (&zdata->write.z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+		Z_DEFAULT_STRATEGY);
+  zdata->read.len = ZSTRM_BUFSIZE;
+  zdata->read.buf = safe_malloc (zdata->read.len);
+  zdata->write.len = ZSTRM_BUFSIZE;
+  zdata->write.buf = safe_malloc (zdata->write.len);
+
+  /* preserve old functions */
+  zdata->sockdata = conn->sockdata;
+  zdata->zstrm_close = conn->conn_close;
+  zdata->zstrm_read = conn->conn_read;
+  zdata->zstrm_write = conn->conn_write;
+  zdata->zstrm_poll = conn->conn_poll;
+
+  /* and set up new functions */
+  conn->sockdata = zdata;
+  conn->conn_close = zstrm_close;
+  conn->conn_read = zstrm_read;
+  conn->conn_write = zstrm_write;
+  conn->conn_poll = zstrm_poll;
+}
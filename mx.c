@@ -29,6 +29,7 @@
 #include "copy.h"
 #include "keymap.h"
 #include "url.h"
+#include "stats.h"
 #ifdef USE_SIDEBAR
 #include "sidebar.h"
 #endif
@@ -608,6 +609,7 @@ CONTEXT *mx_open_mailbox (const char *path, int flags, CONTEXT *pctx)
 {
   CONTEXT *ctx = pctx;
   int rc;
+  stat_time_t t;
 
   if (!path || !path[0])
     return NULL;
@@ -670,7 +672,9 @@ CONTEXT *mx_open_mailbox (const char *path, int flags, CONTEXT *pctx)
   if (!ctx->quiet)
     mutt_message (_("Reading %s..."), ctx->path);
 
+  t = mutt_stats_now ();
   rc = ctx->mx_ops->open(ctx);
+  mutt_stats_add (mutt_stats_open_timer (ctx->magic), t);
 
   if (rc == 0)
   {
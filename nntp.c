@@ -37,6 +37,10 @@
 #include "mutt_ssl.h"
 #endif
 
+#ifdef USE_ZLIB
+#include "mutt_zstrm.h"
+#endif
+
 #ifdef HAVE_PGP
 #include "pgp.h"
 #endif
@@ -87,6 +91,7 @@ static int nntp_capabilities (NNTP_SERVER *nserv)
   nserv->hasLISTGROUP = 0;
   nserv->hasLISTGROUPrange = 0;
   nserv->hasOVER = 0;
+  nserv->hasCOMPRESS = 0;
   FREE (&nserv->authenticators);
 
   if (mutt_socket_write (conn, "CAPABILITIES\r\n") < 0 ||
@@ -129,6 +134,12 @@ static int nntp_capabilities (NNTP_SERVER *nserv)
 #endif
     else if (!mutt_strcmp ("OVER", buf))
       nserv->hasOVER = 1;
+    else if (!mutt_strncmp ("COMPRESS ", buf, 9))
+    {
+      safe_strcat (buf, sizeof (buf), " ");
+      if (strstr (buf + 8, " DEFLATE "))
+	nserv->hasCOMPRESS = 1;
+    }
     else if (!mutt_strncmp ("LIST ", buf, 5))
     {
       char *p = strstr (buf, " NEWSGROUPS");
@@ -742,6 +753,20 @@ int nntp_open_connection (NNTP_SERVER *nserv)
     }
   }
 
+#ifdef USE_ZLIB
+  /* compress the connection, now that TLS and authentication are done */
+  if (nserv->hasCOMPRESS && option (OPTNNTPCOMPRESS))
+  {
+    if (mutt_socket_write (conn, "COMPRESS DEFLATE\r\n") < 0 ||
+	mutt_socket_readln (buf, sizeof (buf), conn) < 0)
+      return nntp_connect_error (nserv);
+    if (!mutt_strncmp ("206", buf, 3))
+      mutt_zstrm_wrap_conn (conn);
+    else
+      dprint (1, (debugfile, "nntp_open_connection: COMPRESS: %s\n", buf));
+  }
+#endif
+
   /* attempt features */
   if (nntp_attempt_features (nserv) < 0)
     return -1;
@@ -810,6 +835,62 @@ static int nntp_query (NNTP_DATA *nntp_data, char *line, size_t linelen)
   return 0;
 }
 
+/* Read the lines of a multi-line response up to the terminating dot and
+ * call funct(*line, *data) for each of them, if funct is given:
+ *  0 - success
+ * -1 - conection lost
+ * -2 - error in funct(*line, *data) */
+static int nntp_read_lines (NNTP_DATA *nntp_data, progress_t *progress,
+			    int (*funct) (char *, void *), void *data)
+{
+  char buf[LONG_STRING];
+  char *line;
+  unsigned int lines = 0;
+  size_t off = 0;
+  int rc = 0;
+
+  line = safe_malloc (sizeof (buf));
+  while (1)
+  {
+    char *p;
+    int chunk = mutt_socket_readln_d (buf, sizeof (buf),
+		nntp_data->nserv->conn, MUTT_SOCK_LOG_HDR);
+    if (chunk < 0)
+    {
+      nntp_data->nserv->status = NNTP_NONE;
+      rc = -1;
+      break;
+    }
+
+    p = buf;
+    if (!off && buf[0] == '.')
+    {
+      if (buf[1] == '\0')
+	break;
+      if (buf[1] == '.')
+	p++;
+    }
+
+    strfcpy (line + off, p, sizeof (buf));
+
+    if (chunk >= sizeof (buf))
+      off += strlen (p);
+    else
+    {
+      if (progress)
+	mutt_progress_update (progress, ++lines, -1);
+
+      if (rc == 0 && funct && funct (line, data) < 0)
+	rc = -2;
+      off = 0;
+    }
+
+    safe_realloc (&line, off + sizeof (buf));
+  }
+  FREE (&line);
+  return rc;
+}
+
 /* This function calls funct(*line, *data) for each received line,
  * funct(NULL, *data) if rewind(*data) needs, exits when fail or done:
  *  0 - success
@@ -819,15 +900,11 @@ static int nntp_query (NNTP_DATA *nntp_data, char *line, size_t linelen)
 static int nntp_fetch_lines (NNTP_DATA *nntp_data, char *query, size_t qlen,
 			char *msg, int (*funct) (char *, void *), void *data)
 {
-  int done = FALSE;
-  int rc;
+  int rc = -1;
 
-  while (!done)
+  while (rc == -1)
   {
     char buf[LONG_STRING];
-    char *line;
-    unsigned int lines = 0;
-    size_t off = 0;
     progress_t progress;
 
     if (msg)
@@ -842,52 +919,29 @@ static int nntp_fetch_lines (NNTP_DATA *nntp_data, char *query, size_t qlen,
       return 1;
     }
 
-    line = safe_malloc (sizeof (buf));
-    rc = 0;
-
-    while (1)
-    {
-      char *p;
-      int chunk = mutt_socket_readln_d (buf, sizeof (buf),
-		  nntp_data->nserv->conn, MUTT_SOCK_LOG_HDR);
-      if (chunk < 0)
-      {
-	nntp_data->nserv->status = NNTP_NONE;
-	break;
-      }
-
-      p = buf;
-      if (!off && buf[0] == '.')
-      {
-	if (buf[1] == '\0')
-	{
-	  done = TRUE;
-	  break;
-	}
-	if (buf[1] == '.')
-	  p++;
-      }
-
-      strfcpy (line + off, p, sizeof (buf));
-
-      if (chunk >= sizeof (buf))
-	off += strlen (p);
-      else
-      {
-	if (msg)
-	  mutt_progress_update (&progress, ++lines, -1);
+    rc = nntp_read_lines (nntp_data, msg ? &progress : NULL, funct, data);
+    funct (NULL, data);
+  }
+  return rc;
+}
 
-	if (rc == 0 && funct (line, data) < 0)
-	  rc = -2;
-	off = 0;
-      }
+/* Read and throw away the answers to count pipelined OVER or HEAD
+ * commands, successful answers to which are multi-line */
+static void nntp_drain (NNTP_DATA *nntp_data, int count)
+{
+  NNTP_SERVER *nserv = nntp_data->nserv;
+  char buf[LONG_STRING];
 
-      safe_realloc (&line, off + sizeof (buf));
+  for (; count > 0 && nserv->status == NNTP_OK; count--)
+  {
+    if (mutt_socket_readln (buf, sizeof (buf), nserv->conn) < 0)
+    {
+      nserv->status = NNTP_NONE;
+      break;
     }
-    FREE (&line);
-    funct (NULL, data);
+    if (buf[0] == '2')
+      nntp_read_lines (nntp_data, NULL, NULL, NULL);
   }
-  return rc;
 }
 
 /* Parse newsgroup description */
@@ -1005,6 +1059,8 @@ typedef struct
   int restore;
   unsigned char *messages;
   progress_t progress;
+  anum_t head_next;		/* next article to send HEAD for */
+  int head_queued;		/* HEAD commands in flight */
 #ifdef USE_HCACHE
   header_cache_t *hc;
 #endif
@@ -1175,12 +1231,166 @@ static int parse_overview_line (char *line, void *data)
   else
     mutt_free_header (&hdr);
 
+  /* don't parse it again if its chunk is requested once more */
+  fc->messages[anum - fc->first] = 0;
+
   /* progress */
   if (!ctx->quiet)
     mutt_progress_update (&fc->progress, anum - fc->first + 1, -1);
   return 0;
 }
 
+/* Fetch header of article anum to file, keeping HEAD commands for up to
+ * $nntp_pipeline_depth of the following articles, which are neither
+ * missing nor cached, in flight:
+ *  0 - success
+ *  1 - bad response (answer in buf)
+ * -1 - conection lost
+ * -2 - error writing file */
+static int nntp_fetch_head (FETCH_CTX *fc, anum_t anum, FILE *fp,
+			    char *buf, size_t buflen)
+{
+  NNTP_DATA *nntp_data = fc->ctx->data;
+  NNTP_SERVER *nserv = nntp_data->nserv;
+  int rc = -1;
+
+  while (rc == -1)
+  {
+    if (nserv->status != NNTP_OK)
+      fc->head_queued = 0;
+
+    /* nothing in flight, nntp_query reconnects if needed */
+    if (!fc->head_queued)
+    {
+      snprintf (buf, buflen, "HEAD " ANUM "\r\n", anum);
+      if (nntp_query (nntp_data, buf, buflen) < 0)
+	return -1;
+      fc->head_next = anum + 1;
+    }
+    else if (mutt_socket_readln (buf, buflen, nserv->conn) < 0)
+    {
+      nserv->status = NNTP_NONE;
+      continue;
+    }
+    else
+      fc->head_queued--;
+
+    /* send requests for the next articles before reading this one */
+    while (fc->head_queued < NntpPipelineDepth &&
+	   fc->head_next <= fc->last && nserv->status == NNTP_OK)
+    {
+      char cmd[SHORT_STRING];
+      anum_t next = fc->head_next++;
+
+      if (!fc->messages[next - fc->first])
+	continue;
+#ifdef USE_HCACHE
+      if (fc->hc)
+      {
+	void *hdata;
+
+	snprintf (cmd, sizeof (cmd), ANUM, next);
+	hdata = mutt_hcache_fetch (fc->hc, cmd, strlen (cmd));
+	if (hdata)
+	{
+	  FREE (&hdata);
+	  continue;
+	}
+      }
+#endif
+      snprintf (cmd, sizeof (cmd), "HEAD " ANUM "\r\n", next);
+      if (mutt_socket_write (nserv->conn, cmd) < 0)
+	break;
+      fc->head_queued++;
+    }
+
+    if (buf[0] != '2')
+      return 1;
+
+    rc = nntp_read_lines (nntp_data, NULL, fetch_tempfile, fp);
+    fetch_tempfile (NULL, fp);
+  }
+  return rc;
+}
+
+/* Fetch overview of articles first..last in chunks of NNTP_OVER_CHUNK,
+ * keeping up to $nntp_pipeline_depth more chunks requested ahead */
+static int nntp_fetch_overview (FETCH_CTX *fc, anum_t first, anum_t last)
+{
+  NNTP_DATA *nntp_data = fc->ctx->data;
+  NNTP_SERVER *nserv = nntp_data->nserv;
+  char *cmd = nserv->hasOVER ? "OVER" : "XOVER";
+  char buf[LONG_STRING];
+  anum_t current = first, next = first;
+  int queued = 0;
+  int rc = 0;
+
+  while (current <= last)
+  {
+    anum_t end = last - current < NNTP_OVER_CHUNK ?
+		 last : current + NNTP_OVER_CHUNK - 1;
+
+    if (nserv->status != NNTP_OK)
+      queued = 0;
+
+    /* nothing in flight, nntp_query reconnects if needed */
+    if (!queued)
+    {
+      snprintf (buf, sizeof (buf), "%s " ANUM "-" ANUM "\r\n",
+		cmd, current, end);
+      if (nntp_query (nntp_data, buf, sizeof (buf)) < 0)
+	return -1;
+      next = end + 1;
+    }
+    else if (mutt_socket_readln (buf, sizeof (buf), nserv->conn) < 0)
+    {
+      nserv->status = NNTP_NONE;
+      continue;
+    }
+    else
+      queued--;
+
+    /* send requests for the next chunks before reading this one */
+    while (queued < NntpPipelineDepth && next <= last &&
+	   nserv->status == NNTP_OK)
+    {
+      char query[SHORT_STRING];
+      anum_t next_end = last - next < NNTP_OVER_CHUNK ?
+			last : next + NNTP_OVER_CHUNK - 1;
+
+      snprintf (query, sizeof (query), "%s " ANUM "-" ANUM "\r\n",
+		cmd, next, next_end);
+      if (mutt_socket_write (nserv->conn, query) < 0)
+	break;
+      next = next_end + 1;
+      queued++;
+    }
+
+    if (buf[0] == '2')
+    {
+      rc = nntp_read_lines (nntp_data, NULL, parse_overview_line, fc);
+      /* connection lost, request this chunk again */
+      if (rc == -1)
+	continue;
+      if (rc < 0)
+	break;
+    }
+
+    /* no articles in this chunk */
+    else if (mutt_strncmp ("423", buf, 3))
+    {
+      mutt_error ("%s: %s", cmd, buf);
+      mutt_sleep (2);
+      rc = 1;
+      break;
+    }
+    current = end + 1;
+  }
+
+  nntp_drain (nntp_data, queued);
+  return rc;
+}
+
 /* Fetch headers */
 static int nntp_fetch_headers (CONTEXT *ctx, void *hc,
 			       anum_t first, anum_t last, int restore)
@@ -1207,6 +1417,8 @@ static int nntp_fetch_headers (CONTEXT *ctx, void *hc,
   fc.last = last;
   fc.restore = restore;
   fc.messages = safe_calloc (last - first + 1, sizeof (unsigned char));
+  fc.head_next = first;
+  fc.head_queued = 0;
 #ifdef USE_HCACHE
   fc.hc = hc;
 #endif
@@ -1339,9 +1551,7 @@ static int nntp_fetch_headers (CONTEXT *ctx, void *hc,
 	break;
       }
 
-      snprintf (buf, sizeof (buf), "HEAD %d\r\n", current);
-      rc = nntp_fetch_lines (nntp_data, buf, sizeof (buf), NULL,
-			     fetch_tempfile, fp);
+      rc = nntp_fetch_head (&fc, current, fp, buf, sizeof (buf));
       if (rc)
       {
 	safe_fclose (&fp);
@@ -1400,18 +1610,12 @@ static int nntp_fetch_headers (CONTEXT *ctx, void *hc,
   if (!option (OPTLISTGROUP) || !nntp_data->nserv->hasLISTGROUP)
     current = first_over;
 
+  /* don't leave answers to pipelined HEAD commands behind */
+  nntp_drain (nntp_data, fc.head_queued);
+
   /* fetch overview information */
-  if (current <= last && rc == 0 && !nntp_data->deleted) {
-    char *cmd = nntp_data->nserv->hasOVER ? "OVER" : "XOVER";
-    snprintf (buf, sizeof (buf), "%s %d-%d\r\n", cmd, current, last);
-    rc = nntp_fetch_lines (nntp_data, buf, sizeof (buf), NULL,
-	 parse_overview_line, &fc);
-    if (rc > 0)
-    {
-      mutt_error ("%s: %s", cmd, buf);
-      mutt_sleep (2);
-    }
-  }
+  if (current <= last && rc == 0 && !nntp_data->deleted)
+    rc = nntp_fetch_overview (&fc, current, last);
 
   if (ctx->msgcount > oldmsgcount)
     mx_update_context (ctx, ctx->msgcount - oldmsgcount);
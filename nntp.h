@@ -39,6 +39,9 @@
 /* number of entries in article cache */
 #define NNTP_ACACHE_LEN 10
 
+/* number of articles per OVER command */
+#define NNTP_OVER_CHUNK 1000
+
 /* article number type and format */
 #define anum_t uint32_t
 #define ANUM "%u"
@@ -61,6 +64,7 @@ typedef struct
   unsigned int hasLISTGROUPrange : 1;
   unsigned int hasOVER : 1;
   unsigned int hasXOVER : 1;
+  unsigned int hasCOMPRESS : 1;
   unsigned int use_tls : 3;
   unsigned int status : 3;
   unsigned int cacheable : 1;
@@ -51,6 +51,9 @@
 #define IsMsgAttach(x) (x && (x)->fp && (x)->bdy && (x)->bdy->hdr)
 #define IsHeader(x) (x && (x)->hdr && !(x)->bdy)
 
+/* number of lines laid out between checks for pending input */
+#define PAGER_LAYOUT_CHUNK 100
+
 static const char *Not_available_in_this_menu = N_("Not available in this menu.");
 static const char *Mailbox_is_read_only = N_("Mailbox is read-only.");
 static const char *Function_not_permitted_in_attach_message_mode = N_("Function not permitted in attach-message mode.");
@@ -112,12 +115,36 @@ struct line_t
   short continuation;
   short chunks;
   short search_cnt;
-  struct syntax_t *syntax;
+  struct syntax_t *syntax;	/* only allocated when chunks > 1 */
   struct syntax_t *search;
   struct q_class_t *quote;
   unsigned int is_cont_hdr; /* this line is a continuation of the previous header line */
+  struct syntax_t syntax0;	/* inline storage for the common case */
 };
 
+#define LINE_SYNTAX(l) ((l).syntax ? (l).syntax : &(l).syntax0)
+
+/* resize the syntax array of a line to hold n chunks.  Lines with at
+ * most one chunk keep it in syntax0 and carry no heap allocation. */
+static void line_syntax_resize (struct line_t *l, int n)
+{
+  if (n <= 1)
+  {
+    if (l->syntax)
+    {
+      l->syntax0 = l->syntax[0];
+      FREE (&l->syntax);
+    }
+  }
+  else if (!l->syntax)
+  {
+    l->syntax = safe_malloc (n * sizeof (struct syntax_t));
+    l->syntax[0] = l->syntax0;
+  }
+  else
+    safe_realloc (&l->syntax, n * sizeof (struct syntax_t));
+}
+
 #define ANSI_OFF       (1<<0)
 #define ANSI_BLINK     (1<<1)
 #define ANSI_BOLD      (1<<2)
@@ -195,15 +222,15 @@ resolve_color (struct line_t *lineInfo, int n, int cnt, int flags, int special,
       addch ('+');
       last_color = ColorDefs[MT_COLOR_MARKERS];
     }
-    m = (lineInfo[n].syntax)[0].first;
-    cnt += (lineInfo[n].syntax)[0].last;
+    m = LINE_SYNTAX (lineInfo[n])[0].first;
+    cnt += LINE_SYNTAX (lineInfo[n])[0].last;
   }
   else
     m = n;
   if (!(flags & MUTT_SHOWCOLOR))
     def_color = ColorDefs[MT_COLOR_NORMAL];
   else if (lineInfo[m].type == MT_COLOR_HEADER)
-    def_color = (lineInfo[m].syntax)[0].color;
+    def_color = LINE_SYNTAX (lineInfo[m])[0].color;
   else
     def_color = ColorDefs[lineInfo[m].type];
 
@@ -229,13 +256,13 @@ resolve_color (struct line_t *lineInfo, int n, int cnt, int flags, int special,
     for (i = 0; i < lineInfo[m].chunks; i++)
     {
       /* we assume the chunks are sorted */
-      if (cnt > (lineInfo[m].syntax)[i].last)
+      if (cnt > LINE_SYNTAX (lineInfo[m])[i].last)
 	continue;
-      if (cnt < (lineInfo[m].syntax)[i].first)
+      if (cnt < LINE_SYNTAX (lineInfo[m])[i].first)
 	break;
-      if (cnt != (lineInfo[m].syntax)[i].last)
+      if (cnt != LINE_SYNTAX (lineInfo[m])[i].last)
       {
-	color = (lineInfo[m].syntax)[i].color;
+	color = LINE_SYNTAX (lineInfo[m])[i].color;
 	break;
       }
       /* don't break here, as cnt might be 
@@ -315,16 +342,16 @@ append_line (struct line_t *lineInfo, int n, int cnt)
   int m;
 
   lineInfo[n+1].type = lineInfo[n].type;
-  (lineInfo[n+1].syntax)[0].color = (lineInfo[n].syntax)[0].color;
+  LINE_SYNTAX (lineInfo[n+1])[0].color = LINE_SYNTAX (lineInfo[n])[0].color;
   lineInfo[n+1].continuation = 1;
 
   /* find the real start of the line */
   for (m = n; m >= 0; m--)
     if (lineInfo[m].continuation == 0) break;
 
-  (lineInfo[n+1].syntax)[0].first = m;
-  (lineInfo[n+1].syntax)[0].last = (lineInfo[n].continuation) ? 
-    cnt + (lineInfo[n].syntax)[0].last : cnt;
+  LINE_SYNTAX (lineInfo[n+1])[0].first = m;
+  LINE_SYNTAX (lineInfo[n+1])[0].last = (lineInfo[n].continuation) ? 
+    cnt + LINE_SYNTAX (lineInfo[n])[0].last : cnt;
 }
 
 static void
@@ -730,7 +757,7 @@ resolve_types (char *buf, char *raw, struct line_t *lineInfo, int n, int last,
       if (n > 0 && (buf[0] == ' ' || buf[0] == '\t'))
       {
 	lineInfo[n].type = lineInfo[n-1].type; /* wrapped line */
-	(lineInfo[n].syntax)[0].color = (lineInfo[n-1].syntax)[0].color;
+	LINE_SYNTAX (lineInfo[n])[0].color = LINE_SYNTAX (lineInfo[n-1])[0].color;
 	lineInfo[n].is_cont_hdr = 1;
       }
       else
@@ -743,7 +770,7 @@ resolve_types (char *buf, char *raw, struct line_t *lineInfo, int n, int last,
 	if (REGEXEC (color_line->rx, buf) == 0)
 	{
 	  lineInfo[n].type = MT_COLOR_HEADER;
-	  lineInfo[n].syntax[0].color = color_line->pair;
+	  LINE_SYNTAX (lineInfo[n])[0].color = color_line->pair;
 	  if (lineInfo[n].is_cont_hdr)
 	  {
 	    /* adjust the previous continuation lines to reflect the color of this continuation line */
@@ -751,13 +778,13 @@ resolve_types (char *buf, char *raw, struct line_t *lineInfo, int n, int last,
 	    for (j = n - 1; j >= 0 && lineInfo[j].is_cont_hdr; --j)
 	    {
 	      lineInfo[j].type = lineInfo[n].type;
-	      lineInfo[j].syntax[0].color = lineInfo[n].syntax[0].color;
+	      LINE_SYNTAX (lineInfo[j])[0].color = LINE_SYNTAX (lineInfo[n])[0].color;
 	    }
 	    /* now adjust the first line of this header field */
 	    if (j >= 0)
 	    {
 	      lineInfo[j].type = lineInfo[n].type;
-	      lineInfo[j].syntax[0].color = lineInfo[n].syntax[0].color;
+	      LINE_SYNTAX (lineInfo[j])[0].color = LINE_SYNTAX (lineInfo[n])[0].color;
 	    }
 	    *force_redraw = 1; /* the previous lines have already been drawn on the screen */
 	  }
@@ -789,8 +816,7 @@ resolve_types (char *buf, char *raw, struct line_t *lineInfo, int n, int last,
 	if (lineInfo[i].chunks)
 	{
 	  lineInfo[i].chunks = 0;
-	  safe_realloc (&(lineInfo[n].syntax), 
-			sizeof (struct syntax_t));
+	  line_syntax_resize (&lineInfo[i], 1);
 	}
 	lineInfo[i++].type = MT_COLOR_SIGNATURE;
       }
@@ -877,20 +903,19 @@ resolve_types (char *buf, char *raw, struct line_t *lineInfo, int n, int last,
                 break;
               }
 	      if (++(lineInfo[n].chunks) > 1)
-		safe_realloc (&(lineInfo[n].syntax), 
-			      (lineInfo[n].chunks) * sizeof (struct syntax_t));
+		line_syntax_resize (&lineInfo[n], lineInfo[n].chunks);
 	    }
 	    i = lineInfo[n].chunks - 1;
 	    pmatch[0].rm_so += offset;
 	    pmatch[0].rm_eo += offset;
 	    if (!found ||
-		pmatch[0].rm_so < (lineInfo[n].syntax)[i].first ||
-		(pmatch[0].rm_so == (lineInfo[n].syntax)[i].first &&
-		 pmatch[0].rm_eo > (lineInfo[n].syntax)[i].last))
+		pmatch[0].rm_so < LINE_SYNTAX (lineInfo[n])[i].first ||
+		(pmatch[0].rm_so == LINE_SYNTAX (lineInfo[n])[i].first &&
+		 pmatch[0].rm_eo > LINE_SYNTAX (lineInfo[n])[i].last))
 	    {
-	      (lineInfo[n].syntax)[i].color = color_line->pair;
-	      (lineInfo[n].syntax)[i].first = pmatch[0].rm_so;
-	      (lineInfo[n].syntax)[i].last = pmatch[0].rm_eo;
+	      LINE_SYNTAX (lineInfo[n])[i].color = color_line->pair;
+	      LINE_SYNTAX (lineInfo[n])[i].first = pmatch[0].rm_so;
+	      LINE_SYNTAX (lineInfo[n])[i].last = pmatch[0].rm_eo;
 	    }
 	    found = 1;
 	    null_rx = 0;
@@ -904,7 +929,7 @@ resolve_types (char *buf, char *raw, struct line_t *lineInfo, int n, int last,
       if (null_rx)
 	offset++; /* avoid degenerate cases */
       else
-	offset = (lineInfo[n].syntax)[i].last;
+	offset = LINE_SYNTAX (lineInfo[n])[i].last;
     } while (found || null_rx);
     if (nl > 0)
       buf[nl] = '\n';
@@ -940,20 +965,19 @@ resolve_types (char *buf, char *raw, struct line_t *lineInfo, int n, int last,
 	    if (!found)
 	    {
 	      if (++(lineInfo[n].chunks) > 1)
-		safe_realloc (&(lineInfo[n].syntax),
-			      (lineInfo[n].chunks) * sizeof (struct syntax_t));
+		line_syntax_resize (&lineInfo[n], lineInfo[n].chunks);
 	    }
 	    i = lineInfo[n].chunks - 1;
 	    pmatch[0].rm_so += offset;
 	    pmatch[0].rm_eo += offset;
 	    if (!found ||
-		 pmatch[0].rm_so <  (lineInfo[n].syntax)[i].first ||
-		(pmatch[0].rm_so == (lineInfo[n].syntax)[i].first &&
-		 pmatch[0].rm_eo >  (lineInfo[n].syntax)[i].last))
+		 pmatch[0].rm_so <  LINE_SYNTAX (lineInfo[n])[i].first ||
+		(pmatch[0].rm_so == LINE_SYNTAX (lineInfo[n])[i].first &&
+		 pmatch[0].rm_eo >  LINE_SYNTAX (lineInfo[n])[i].last))
 	    {
-	      (lineInfo[n].syntax)[i].color = color_line->pair;
-	      (lineInfo[n].syntax)[i].first = pmatch[0].rm_so;
-	      (lineInfo[n].syntax)[i].last  = pmatch[0].rm_eo;
+	      LINE_SYNTAX (lineInfo[n])[i].color = color_line->pair;
+	      LINE_SYNTAX (lineInfo[n])[i].first = pmatch[0].rm_so;
+	      LINE_SYNTAX (lineInfo[n])[i].last  = pmatch[0].rm_eo;
 	    }
 	    found = 1;
 	    null_rx = 0;
@@ -966,7 +990,7 @@ resolve_types (char *buf, char *raw, struct line_t *lineInfo, int n, int last,
       if (null_rx)
 	offset++; /* avoid degenerate cases */
       else
-	offset = (lineInfo[n].syntax)[i].last;
+	offset = LINE_SYNTAX (lineInfo[n])[i].last;
     } while (found || null_rx);
     if (nl > 0)
       buf[nl] = '\n';
@@ -1395,14 +1419,15 @@ display_line (FILE *f, LOFF_T *last_pos, struct line_t **lineInfo, int n,
 
   if (*last == *max)
   {
-    safe_realloc (lineInfo, sizeof (struct line_t) * (*max += LINES));
+    /* grow geometrically so laying out a huge message isn't quadratic */
+    safe_realloc (lineInfo, sizeof (struct line_t) *
+		  (*max += (*max > LINES ? *max / 2 : LINES)));
     for (ch = *last; ch < *max ; ch++)
     {
       memset (&((*lineInfo)[ch]), 0, sizeof (struct line_t));
       (*lineInfo)[ch].type = -1;
       (*lineInfo)[ch].search_cnt = -1;
-      (*lineInfo)[ch].syntax = safe_malloc (sizeof (struct syntax_t));
-      ((*lineInfo)[ch].syntax)[0].first = ((*lineInfo)[ch].syntax)[0].last = -1;
+      (*lineInfo)[ch].syntax0.first = (*lineInfo)[ch].syntax0.last = -1;
     }
   }
 
@@ -1579,9 +1604,9 @@ display_line (FILE *f, LOFF_T *last_pos, struct line_t **lineInfo, int n,
    */
   if (flags & MUTT_SHOWCOLOR)
   {
-    m = ((*lineInfo)[n].continuation) ? ((*lineInfo)[n].syntax)[0].first : n;
+    m = ((*lineInfo)[n].continuation) ? LINE_SYNTAX ((*lineInfo)[n])[0].first : n;
     if ((*lineInfo)[m].type == MT_COLOR_HEADER)
-      def_color = ((*lineInfo)[m].syntax)[0].color;
+      def_color = LINE_SYNTAX ((*lineInfo)[m])[0].color;
     else
       def_color = ColorDefs[ (*lineInfo)[m].type ];
 
@@ -1731,8 +1756,7 @@ mutt_pager (const char *banner, const char *fname, int flags, pager_t *extra)
     memset (&lineInfo[i], 0, sizeof (struct line_t));
     lineInfo[i].type = -1;
     lineInfo[i].search_cnt = -1;
-    lineInfo[i].syntax = safe_malloc (sizeof (struct syntax_t));
-    (lineInfo[i].syntax)[0].first = (lineInfo[i].syntax)[0].last = -1;
+    lineInfo[i].syntax0.first = lineInfo[i].syntax0.last = -1;
   }
 
   mutt_compile_help (helpstr, sizeof (helpstr), MENU_PAGER, PagerHelp);
@@ -2015,7 +2039,33 @@ mutt_pager (const char *banner, const char *fname, int flags, pager_t *extra)
     }
     else
       OldHdr = NULL;
-      
+
+    /* while the user is idle, lay out the rest of the message a chunk at
+     * a time so that <bottom> and searching don't have to do it all at
+     * once.  Stop as soon as a key is pending. */
+    if (lineInfo[lastLine].offset < sb.st_size && !mutt_input_pending ())
+    {
+      LOFF_T saved_pos = last_pos;
+      int n = lastLine, k;
+
+      do
+      {
+	for (k = 0; k < PAGER_LAYOUT_CHUNK; k++, n++)
+	  if (display_line (fp, &last_pos, &lineInfo, n, &lastLine, &maxLine,
+			    has_types | (flags & MUTT_PAGER_NOWRAP),
+			    &QuoteList, &q_level, &force_redraw,
+			    &SearchRE, pager_window) != 0)
+	    break;
+      } while (k == PAGER_LAYOUT_CHUNK && !mutt_input_pending ());
+
+      /* the status line and fill_buffer() rely on last_pos */
+      if (last_pos != saved_pos)
+      {
+	fseeko (fp, saved_pos, SEEK_SET);
+	last_pos = saved_pos;
+      }
+    }
+
     ch = km_dokey (MENU_PAGER);
     if (ch != -1)
       mutt_clear_error ();
@@ -2137,8 +2187,7 @@ mutt_pager (const char *banner, const char *fname, int flags, pager_t *extra)
 	  lineInfo[i].search_cnt = -1;
 	  lineInfo[i].quote = NULL;
 
-	  safe_realloc (&(lineInfo[i].syntax),
-			sizeof (struct syntax_t));
+	  line_syntax_resize (&lineInfo[i], 1);
 	  if (SearchCompiled && lineInfo[i].search)
 	      FREE (&(lineInfo[i].search));
 	}
@@ -2732,7 +2781,7 @@ search_next:
 	    lineInfo[i].search_cnt = -1;
 	    lineInfo[i].quote = NULL;
 
-	    safe_realloc (&(lineInfo[i].syntax), sizeof (struct syntax_t));
+	    line_syntax_resize (&lineInfo[i], 1);
 	    if (SearchCompiled && lineInfo[i].search)
 		FREE (&(lineInfo[i].search));
 	  }
@@ -25,6 +25,7 @@
 #include "keymap.h"
 #include "mailbox.h"
 #include "copy.h"
+#include "stats.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -1033,11 +1034,13 @@ pattern_t *mutt_pattern_comp (/* const */ char *s, int flags, BUFFER *err)
   return (curlist);
 }
 
+static int pattern_exec (struct pattern_t *, pattern_exec_flag, CONTEXT *, HEADER *);
+
 static int
 perform_and (pattern_t *pat, pattern_exec_flag flags, CONTEXT *ctx, HEADER *hdr)
 {
   for (; pat; pat = pat->next)
-    if (mutt_pattern_exec (pat, flags, ctx, hdr) <= 0)
+    if (pattern_exec (pat, flags, ctx, hdr) <= 0)
       return 0;
   return 1;
 }
@@ -1046,7 +1049,7 @@ static int
 perform_or (struct pattern_t *pat, pattern_exec_flag flags, CONTEXT *ctx, HEADER *hdr)
 {
   for (; pat; pat = pat->next)
-    if (mutt_pattern_exec (pat, flags, ctx, hdr) > 0)
+    if (pattern_exec (pat, flags, ctx, hdr) > 0)
       return 1;
   return 0;
 }
@@ -1131,7 +1134,7 @@ static int match_threadcomplete(struct pattern_t *pat, pattern_exec_flag flags,
     return 0;
   h = t->message;
   if(h)
-    if(mutt_pattern_exec(pat, flags, ctx, h))
+    if(pattern_exec(pat, flags, ctx, h))
       return 1;
 
   if(up && (a=match_threadcomplete(pat, flags, ctx, t->parent,1,1,1,0)))
@@ -1145,10 +1148,81 @@ static int match_threadcomplete(struct pattern_t *pat, pattern_exec_flag flags,
   return 0;
 }
 
+#ifdef USE_IMAP
+/* does the pattern look at anything but the flags, dates and size of a
+ * message?  Those are all a lazy IMAP header has ($imap_lazy_headers).
+ * Returns 2 if it needs the envelopes of the other messages too: a
+ * message is superseded by the Supersedes: header of another one. */
+static int pattern_needs_envelope (const pattern_t *pat)
+{
+  int rc = 0;
+
+  for (; pat; pat = pat->next)
+  {
+    switch (pat->op)
+    {
+      case MUTT_AND:
+      case MUTT_OR:
+	rc = MAX (rc, pattern_needs_envelope (pat->child));
+	break;
+      case MUTT_SUPERSEDED:
+	return 2;
+      case MUTT_ALL:
+      case MUTT_FLAG:
+      case MUTT_TAG:
+      case MUTT_NEW:
+      case MUTT_UNREAD:
+      case MUTT_REPLIED:
+      case MUTT_OLD:
+      case MUTT_READ:
+      case MUTT_DELETED:
+      case MUTT_MESSAGE:
+      case MUTT_DATE_RECEIVED:
+      case MUTT_BODY:
+      case MUTT_HEADER:
+      case MUTT_WHOLE_MSG:
+      case MUTT_SIZE:
+      case MUTT_COLLAPSED:
+	break;
+      default:
+	rc = MAX (rc, 1);
+    }
+    if (rc == 2)
+      break;
+  }
+  return rc;
+}
+#endif
+
 /* flags
    	MUTT_MATCH_FULL_ADDRESS	match both personal and machine address */
 int
 mutt_pattern_exec (struct pattern_t *pat, pattern_exec_flag flags, CONTEXT *ctx, HEADER *h)
+{
+  stat_time_t t = mutt_stats_now ();
+  int rc;
+
+#ifdef USE_IMAP
+  /* a lazily opened message may be missing the envelope */
+  if (ctx && ctx->magic == MUTT_IMAP)
+    switch (pattern_needs_envelope (pat))
+    {
+      case 2:
+	imap_fetch_envelopes (ctx, 0, ctx->msgcount);
+	break;
+      case 1:
+	imap_fetch_envelope (ctx, h);
+	break;
+    }
+#endif
+
+  rc = pattern_exec (pat, flags, ctx, h);
+  mutt_stats_add (STAT_PATTERN, t);
+  return rc;
+}
+
+static int
+pattern_exec (struct pattern_t *pat, pattern_exec_flag flags, CONTEXT *ctx, HEADER *h)
 {
   switch (pat->op)
   {
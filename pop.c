@@ -52,6 +52,73 @@ static int fetch_message (char *line, void *file)
   return 0;
 }
 
+/* number of TOP commands kept in flight when the server does PIPELINING */
+#define POP_PIPELINE_DEPTH 32
+
+/* header lines of one message, collected in memory */
+typedef struct
+{
+  BUFFER *buf;
+  int lines;
+} POP_HEADER;
+
+static int fetch_header (char *line, void *data)
+{
+  POP_HEADER *ph = (POP_HEADER *) data;
+
+  mutt_buffer_addstr (ph->buf, line);
+  mutt_buffer_addch (ph->buf, '\n');
+  ph->lines++;
+
+  return 0;
+}
+
+static int fetch_discard (char *line, void *data)
+{
+  return 0;
+}
+
+/*
+ * Parse the header collected in ph into h.  length is the size of the
+ * whole message as reported by LIST.  The parser wants a FILE, so unless
+ * fmemopen() is usable the text goes through a single scratch file that
+ * is reused for every message.
+ * returns:
+ *  0 on success
+ * -3 - error writing to tempfile
+ */
+static int pop_parse_header (HEADER *h, POP_HEADER *ph, long length,
+			     FILE *scratch)
+{
+  FILE *f = NULL;
+  size_t len = ph->buf->dptr - ph->buf->data;
+
+#ifdef USE_FMEMOPEN
+  if (len)
+    f = fmemopen (ph->buf->data, len, "r");
+  else /* fmemopen cannot handle empty buffers */
+#endif
+  if ((f = scratch) != NULL)
+  {
+    rewind (f);
+    if (fwrite (ph->buf->data, 1, len, f) != len || fflush (f) != 0 ||
+	ftruncate (fileno (f), len) != 0)
+      return -3;
+    rewind (f);
+  }
+  if (!f)
+    return -3;
+
+  h->env = mutt_read_rfc822_header (f, h, 0, 0);
+  /* the server counts CRLF line endings, we stored LF */
+  h->content->length = length - h->content->offset - ph->lines;
+
+  if (f != scratch)
+    safe_fclose (&f);
+
+  return 0;
+}
+
 /*
  * Read header
  * returns:
@@ -60,20 +127,15 @@ static int fetch_message (char *line, void *file)
  * -2 - invalid command or execution error,
  * -3 - error writing to tempfile
  */
-static int pop_read_header (POP_DATA *pop_data, HEADER *h)
+static int pop_read_header (POP_DATA *pop_data, HEADER *h, FILE *scratch)
 {
-  FILE *f;
   int ret, index;
-  long length;
+  long length = 0;
   char buf[LONG_STRING];
-  char tempfile[_POSIX_PATH_MAX];
+  POP_HEADER ph;
 
-  mutt_mktemp (tempfile, sizeof (tempfile));
-  if (!(f = safe_fopen (tempfile, "w+")))
-  {
-    mutt_perror (tempfile);
-    return -3;
-  }
+  ph.buf = mutt_buffer_new ();
+  ph.lines = 0;
 
   snprintf (buf, sizeof (buf), "LIST %d\r\n", h->refno);
   ret = pop_query (pop_data, buf, sizeof (buf));
@@ -82,7 +144,7 @@ static int pop_read_header (POP_DATA *pop_data, HEADER *h)
     sscanf (buf, "+OK %d %ld", &index, &length);
 
     snprintf (buf, sizeof (buf), "TOP %d 0\r\n", h->refno);
-    ret = pop_fetch_data (pop_data, buf, NULL, fetch_message, f);
+    ret = pop_fetch_data (pop_data, buf, NULL, fetch_header, &ph);
 
     if (pop_data->cmd_top == 2)
     {
@@ -104,21 +166,11 @@ static int pop_read_header (POP_DATA *pop_data, HEADER *h)
     }
   }
 
+  if (ret == 0)
+    ret = pop_parse_header (h, &ph, length, scratch);
+
   switch (ret)
   {
-    case 0:
-    {
-      rewind (f);
-      h->env = mutt_read_rfc822_header (f, h, 0, 0);
-      h->content->length = length - h->content->offset + 1;
-      rewind (f);
-      while (!feof (f))
-      {
-	h->content->length--;
-	fgets (buf, sizeof (buf), f);
-      }
-      break;
-    }
     case -2:
     {
       mutt_error ("%s", pop_data->err_msg);
@@ -131,8 +183,134 @@ static int pop_read_header (POP_DATA *pop_data, HEADER *h)
     }
   }
 
-  safe_fclose (&f);
-  unlink (tempfile);
+  mutt_buffer_free (&ph.buf);
+  return ret;
+}
+
+/* parse bulk LIST output into the size table */
+typedef struct
+{
+  long *sizes;
+  int max;
+} POP_SIZES;
+
+static int fetch_list (char *line, void *data)
+{
+  POP_SIZES *ps = (POP_SIZES *) data;
+  int index;
+  long length;
+
+  if (sscanf (line, "%d %ld", &index, &length) == 2 &&
+      index >= 0 && index < ps->max)
+    ps->sizes[index] = length;
+
+  return 0;
+}
+
+/*
+ * Read the headers of ctx->hdrs[first..last-1] which are not marked in
+ * cached[], keeping up to POP_PIPELINE_DEPTH TOP commands outstanding.
+ * Message sizes come from one bulk LIST.  *failed is set to the index of
+ * the first header that could not be read (last if none).
+ * returns as pop_read_header()
+ */
+static int pop_read_headers_pipelined (CONTEXT *ctx, int first, int last,
+				       const char *cached, FILE *scratch,
+				       progress_t *progress, int *done,
+				       int *failed)
+{
+  POP_DATA *pop_data = (POP_DATA *) ctx->data;
+  char buf[LONG_STRING];
+  POP_SIZES ps;
+  POP_HEADER ph;
+  int i, sent, inflight = 0, ret;
+
+  *failed = first;
+
+  ps.max = 0;
+  for (i = first; i < last; i++)
+    if (ctx->hdrs[i]->refno >= ps.max)
+      ps.max = ctx->hdrs[i]->refno + 1;
+  ps.sizes = safe_calloc (ps.max, sizeof (long));
+  if ((ret = pop_fetch_data (pop_data, "LIST\r\n", NULL, fetch_list, &ps)) < 0)
+  {
+    FREE (&ps.sizes);
+    if (ret == -2)
+      mutt_error ("%s", pop_data->err_msg);
+    return ret;
+  }
+
+  ph.buf = mutt_buffer_new ();
+
+  for (i = first, sent = first; i < last; i++)
+  {
+    if (cached[i - first])
+      continue;
+
+    /* keep the pipe full */
+    for (; sent < last && inflight < POP_PIPELINE_DEPTH; sent++)
+    {
+      if (cached[sent - first])
+	continue;
+      snprintf (buf, sizeof (buf), "TOP %d 0\r\n", ctx->hdrs[sent]->refno);
+      if (mutt_socket_write (pop_data->conn, buf) < 0)
+      {
+	pop_data->status = POP_DISCONNECTED;
+	ret = -1;
+	goto out;
+      }
+      inflight++;
+    }
+
+    inflight--;
+    if (mutt_socket_readln (buf, sizeof (buf), pop_data->conn) < 0)
+    {
+      pop_data->status = POP_DISCONNECTED;
+      ret = -1;
+      goto out;
+    }
+    if (mutt_strncmp (buf, "+OK", 3))
+    {
+      strfcpy (pop_data->err_msg, "TOP: ", sizeof (pop_data->err_msg));
+      pop_error (pop_data, buf);
+      ret = -2;
+      break;
+    }
+
+    ph.buf->dptr = ph.buf->data;
+    ph.lines = 0;
+    if ((ret = pop_read_data (pop_data, NULL, fetch_header, &ph)) < 0 ||
+	(ret = pop_parse_header (ctx->hdrs[i], &ph,
+				 ctx->hdrs[i]->refno < ps.max ?
+				 ps.sizes[ctx->hdrs[i]->refno] : 0,
+				 scratch)) < 0)
+      break;
+
+    if (!ctx->quiet)
+      mutt_progress_update (progress, ++(*done), -1);
+  }
+
+  /* drain what is still in flight after an error */
+  for (; inflight > 0 && ret != -1; inflight--)
+  {
+    if (mutt_socket_readln (buf, sizeof (buf), pop_data->conn) < 0)
+    {
+      pop_data->status = POP_DISCONNECTED;
+      ret = -1;
+    }
+    else if (!mutt_strncmp (buf, "+OK", 3) &&
+	     pop_read_data (pop_data, NULL, fetch_discard, NULL) == -1)
+      ret = -1;
+  }
+
+out:
+  *failed = i;
+  if (ret == -2)
+    mutt_error ("%s", pop_data->err_msg);
+  else if (ret == -3)
+    mutt_error _("Can't write header to temporary file!");
+  mutt_buffer_free (&ph.buf);
+  FREE (&ps.sizes);
   return ret;
 }
 
@@ -235,10 +413,13 @@ static header_cache_t *pop_hcache_open (POP_DATA *pop_data, const char *path)
  */
 static int pop_fetch_headers (CONTEXT *ctx)
 {
-  int i, ret, old_count, new_count, deleted;
+  int i, ret, old_count, new_count, deleted, failed, done = 0;
   unsigned short hcached = 0, bcached;
   POP_DATA *pop_data = (POP_DATA *)ctx->data;
   progress_t progress;
+  char *cached;
+  char tempfile[_POSIX_PATH_MAX];
+  FILE *scratch;
 
 #ifdef USE_HCACHE
   header_cache_t *hc = NULL;
@@ -298,11 +479,13 @@ static int pop_fetch_headers (CONTEXT *ctx)
       mutt_sleep (2);
     }
 
+    cached = safe_calloc (new_count - old_count + 1, 1);
+    failed = new_count;
+
+    /* first take what we can from the header cache */
+#if USE_HCACHE
     for (i = old_count; i < new_count; i++)
     {
-      if (!ctx->quiet)
-	mutt_progress_update (&progress, i + 1 - old_count, -1);
-#if USE_HCACHE
       if ((data = mutt_hcache_fetch (hc, ctx->hdrs[i]->data, strlen(ctx->hdrs[i]->data))))
       {
 	char *uidl = safe_strdup (ctx->hdrs[i]->data);
@@ -323,21 +506,54 @@ static int pop_fetch_headers (CONTEXT *ctx)
 	ctx->hdrs[i]->refno = refno;
 	ctx->hdrs[i]->index = index;
 	ctx->hdrs[i]->data = uidl;
-	ret = 0;
-	hcached = 1;
+	cached[i - old_count] = 1;
+	if (!ctx->quiet)
+	  mutt_progress_update (&progress, ++done, -1);
       }
-      else
+      FREE(&data);
+    }
 #endif
-      if ((ret = pop_read_header (pop_data, ctx->hdrs[i])) < 0)
-	break;
-#if USE_HCACHE
-      else
+
+    /* then fetch the rest from the server, pipelined if possible */
+    mutt_mktemp (tempfile, sizeof (tempfile));
+    if (!(scratch = safe_fopen (tempfile, "w+")))
+    {
+      mutt_perror (tempfile);
+      ret = -3;
+      failed = old_count;
+    }
+    else if (pop_data->cmd_pipelining && pop_data->cmd_top == 1 &&
+	     done < new_count - old_count - 1)
+      ret = pop_read_headers_pipelined (ctx, old_count, new_count, cached,
+					scratch, &progress, &done, &failed);
+    else
+    {
+      for (i = old_count; i < new_count; i++)
       {
-	mutt_hcache_store (hc, ctx->hdrs[i]->data, strlen(ctx->hdrs[i]->data), 
-                       ctx->hdrs[i], 0);
+	if (cached[i - old_count])
+	  continue;
+	if ((ret = pop_read_header (pop_data, ctx->hdrs[i], scratch)) < 0)
+	{
+	  failed = i;
+	  break;
+	}
+	if (!ctx->quiet)
+	  mutt_progress_update (&progress, ++done, -1);
       }
+    }
+    if (scratch)
+    {
+      safe_fclose (&scratch);
+      unlink (tempfile);
+    }
 
-      FREE(&data);
+    for (i = old_count; i < failed; i++)
+    {
+      hcached = cached[i - old_count];
+#if USE_HCACHE
+      if (!hcached)
+	mutt_hcache_store (hc, ctx->hdrs[i]->data, strlen(ctx->hdrs[i]->data), 
+                       ctx->hdrs[i], 0);
 #endif
 
       /*
@@ -370,6 +586,7 @@ static int pop_fetch_headers (CONTEXT *ctx)
 
       ctx->msgcount++;
     }
+    FREE (&cached);
 
     if (i > old_count)
       mx_update_context (ctx, i - old_count);
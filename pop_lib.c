@@ -119,6 +119,9 @@ static int fetch_capa (char *line, void *data)
   else if (!ascii_strncasecmp (line, "TOP", 3))
     pop_data->cmd_top = 1;
 
+  else if (!ascii_strncasecmp (line, "PIPELINING", 10))
+    pop_data->cmd_pipelining = 1;
+
   return 0;
 }
 
@@ -165,6 +168,7 @@ static int pop_capabilities (POP_DATA *pop_data, int mode)
     pop_data->cmd_user = 0;
     pop_data->cmd_uidl = 0;
     pop_data->cmd_top = 0;
+    pop_data->cmd_pipelining = 0;
     pop_data->resp_codes = 0;
     pop_data->expire = 1;
     pop_data->login_delay = 0;
@@ -464,17 +468,31 @@ int pop_fetch_data (POP_DATA *pop_data, char *query, progress_t *progressbar,
 		    int (*funct) (char *, void *), void *data)
 {
   char buf[LONG_STRING];
-  char *inbuf;
-  char *p;
-  int ret, chunk = 0;
-  long pos = 0;
-  size_t lenbuf = 0;
+  int ret;
 
   strfcpy (buf, query, sizeof (buf));
   ret = pop_query (pop_data, buf, sizeof (buf));
   if (ret < 0)
     return ret;
 
+  return pop_read_data (pop_data, progressbar, funct, data);
+}
+
+/*
+ * Read the multi-line part of a response whose status line has already
+ * been consumed, calling funct(*line, *data) for each line.  Used directly
+ * when commands are pipelined.  Returns as pop_fetch_data().
+ */
+int pop_read_data (POP_DATA *pop_data, progress_t *progressbar,
+		   int (*funct) (char *, void *), void *data)
+{
+  char buf[LONG_STRING];
+  char *inbuf;
+  char *p;
+  int ret = 0, chunk = 0;
+  long pos = 0;
+  size_t lenbuf = 0;
+
   inbuf = safe_malloc (sizeof (buf));
 
   FOREVER
@@ -50,6 +50,11 @@
 #include "mx.h"
 #endif
 
+#ifdef USE_IMAP
+#include "mx.h"
+#include "imap/imap.h"
+#endif
+
 #ifdef MIXMASTER
 #include "remailer.h"
 #endif
@@ -1421,6 +1426,19 @@ ci_send_message (int flags,		/* send mode */
     }
   }
 
+#ifdef USE_IMAP
+  /* a reply or forward needs the envelopes of lazily opened messages */
+  if (ctx && ctx->magic == MUTT_IMAP && (flags & (SENDREPLY | SENDFORWARD)))
+  {
+    if (cur)
+      imap_fetch_envelope (ctx, cur);
+    else
+      for (i = 0; i < ctx->msgcount; i++)
+	if (ctx->hdrs[i]->tagged)
+	  imap_fetch_envelope (ctx, ctx->hdrs[i]);
+  }
+#endif
+
   /* this is handled here so that the user can match ~f in send-hook */
   if (cur && option (OPTREVNAME) && !(flags & (SENDPOSTPONED|SENDRESEND)))
   {
@@ -79,12 +79,47 @@ const char B64Chars[64] = {
 
 static void transform_to_7bit (BODY *a, FILE *fpin);
 
+/*
+ * The encoders read their input in blocks through fgetconvbuf() rather
+ * than calling fgetconv() for every character.
+ */
+typedef struct
+{
+  FGETCONV *fc;
+  char buf[HUGE_STRING];
+  size_t pos;
+  size_t len;
+} ENCODE_INPUT;
+
+static void encode_input_init (ENCODE_INPUT *in, FGETCONV *fc)
+{
+  in->fc = fc;
+  in->pos = in->len = 0;
+}
+
+static int encode_fill (ENCODE_INPUT *in)
+{
+  in->pos = 0;
+  in->len = fgetconvbuf (in->buf, sizeof (in->buf), in->fc);
+  return in->len > 0;
+}
+
+static int encode_getc (ENCODE_INPUT *in)
+{
+  if (in->pos == in->len && !encode_fill (in))
+    return EOF;
+  return (unsigned char) in->buf[in->pos++];
+}
+
 static void encode_quoted (FGETCONV * fc, FILE *fout, int istext)
 {
+  ENCODE_INPUT in;
   int c, linelen = 0;
   char line[77], savechar;
 
-  while ((c = fgetconv (fc)) != EOF)
+  encode_input_init (&in, fc);
+
+  while ((c = encode_getc (&in)) != EOF)
   {
     /* Wrap the line if needed. */
     if (linelen == 76 && ((istext && c != '\n') || !istext))
@@ -211,96 +246,110 @@ static void encode_quoted (FGETCONV * fc, FILE *fout, int istext)
   }
 }
 
-static char b64_buffer[3];
-static short b64_num;
-static short b64_linelen;
-
-static void b64_flush(FILE *fout)
+/* Encode a group of up to three bytes, wrapping lines at 72 characters. */
+static char *b64_encode_group (char *ob, const unsigned char *in, int n,
+			       int *linelen)
 {
-  short i;
-
-  if(!b64_num)
-    return;
-
-  if(b64_linelen >= 72)
-  {
-    fputc('\n', fout);
-    b64_linelen = 0;
-  }
-
-  for(i = b64_num; i < 3; i++)
-    b64_buffer[i] = '\0';
-
-  fputc(B64Chars[(b64_buffer[0] >> 2) & 0x3f], fout);
-  b64_linelen++;
-  fputc(B64Chars[((b64_buffer[0] & 0x3) << 4) | ((b64_buffer[1] >> 4) & 0xf) ], fout);
-  b64_linelen++;
-
-  if(b64_num > 1)
-  {
-    fputc(B64Chars[((b64_buffer[1] & 0xf) << 2) | ((b64_buffer[2] >> 6) & 0x3) ], fout);
-    b64_linelen++;
-    if(b64_num > 2)
-    {
-      fputc(B64Chars[b64_buffer[2] & 0x3f], fout);
-      b64_linelen++;
-    }
-  }
-
-  while(b64_linelen % 4)
+  if (*linelen >= 72)
   {
-    fputc('=', fout);
-    b64_linelen++;
+    *ob++ = '\n';
+    *linelen = 0;
   }
 
-  b64_num = 0;
-}
-
+  *ob++ = B64Chars[in[0] >> 2];
+  *ob++ = B64Chars[((in[0] & 0x3) << 4) | (n > 1 ? in[1] >> 4 : 0)];
+  *ob++ = n > 1 ? B64Chars[((in[1] & 0xf) << 2) | (n > 2 ? in[2] >> 6 : 0)] : '=';
+  *ob++ = n > 2 ? B64Chars[in[2] & 0x3f] : '=';
+  *linelen += 4;
 
-static void b64_putc(char c, FILE *fout)
-{
-  if(b64_num == 3)
-    b64_flush(fout);
-
-  b64_buffer[b64_num++] = c;
+  return ob;
 }
 
-
 static void encode_base64 (FGETCONV * fc, FILE *fout, int istext)
 {
-  int ch, ch1 = EOF;
+  ENCODE_INPUT in;
+  const unsigned char *p;
+  unsigned char group[3];
+  char bufo[HUGE_STRING + 16], *ob = bufo;
+  int ch, ch1 = EOF, n = 0, linelen = 0;
+  size_t i;
 
-  b64_num = b64_linelen = 0;
+  encode_input_init (&in, fc);
 
-  while ((ch = fgetconv (fc)) != EOF)
+  while (encode_fill (&in))
   {
     if (SigInt == 1) {
       SigInt = 0;
+      fwrite (bufo, 1, ob - bufo, fout);
       return;
     }
-    if (istext && ch == '\n' && ch1 != '\r')
-      b64_putc('\r', fout);
-    b64_putc(ch, fout);
-    ch1 = ch;
+
+    p = (const unsigned char *) in.buf;
+    for (i = 0; i < in.len; i++)
+    {
+      /* without CRLF conversion, whole groups come straight from the input */
+      if (!istext && !n)
+      {
+	for (; i + 3 <= in.len; i += 3)
+	{
+	  ob = b64_encode_group (ob, p + i, 3, &linelen);
+	  if (ob - bufo >= HUGE_STRING)
+	  {
+	    fwrite (bufo, 1, ob - bufo, fout);
+	    ob = bufo;
+	  }
+	}
+	if (i == in.len)
+	  break;
+      }
+
+      ch = p[i];
+      if (istext && ch == '\n' && ch1 != '\r')
+      {
+	group[n++] = '\r';
+	if (n == 3)
+	{
+	  ob = b64_encode_group (ob, group, n, &linelen);
+	  n = 0;
+	}
+      }
+      group[n++] = ch;
+      ch1 = ch;
+      if (n == 3)
+      {
+	ob = b64_encode_group (ob, group, n, &linelen);
+	n = 0;
+      }
+
+      if (ob - bufo >= HUGE_STRING)
+      {
+	fwrite (bufo, 1, ob - bufo, fout);
+	ob = bufo;
+      }
+    }
   }
-  b64_flush(fout);
-  fputc('\n', fout);
+
+  if (n)
+    ob = b64_encode_group (ob, group, n, &linelen);
+  *ob++ = '\n';
+  fwrite (bufo, 1, ob - bufo, fout);
 }
 
 static void encode_8bit (FGETCONV *fc, FILE *fout, int istext)
 {
-  int ch;
+  ENCODE_INPUT in;
 
-  while ((ch = fgetconv (fc)) != EOF) {
+  encode_input_init (&in, fc);
+
+  while (encode_fill (&in)) {
     if (SigInt == 1) {
       SigInt = 0;
       return;
     }
-    fputc (ch, fout);
+    fwrite (in.buf, 1, in.len, fout);
   }
 }
 
-
 int mutt_write_mime_header (BODY *a, FILE *f)
 {
   PARAMETER *p;
@@ -517,6 +566,43 @@ typedef struct
 CONTENT_STATE;
 
 
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGH 0x8080808080808080ULL
+
+/*
+ * Length of the run at the start of d made only of printable non-blank
+ * ascii and 8-bit characters; the number of 8-bit ones is added to
+ * *hibin.  Eight bytes are checked at a time.
+ */
+static size_t content_run (const char *d, size_t dlen, long *hibin)
+{
+  const char *p = d, *end = d + dlen;
+  uint64_t w, y, v;
+  long hi = 0;
+
+  for (; end - p >= 8; p += 8)
+  {
+    memcpy (&w, p, sizeof (w));
+    y = w & ~SWAR_HIGH;
+    v = y ^ (0x7f * SWAR_ONES);
+    /* any 7-bit byte below 0x21 (control or blank) or equal to 0x7f? */
+    if ((((y - 0x21 * SWAR_ONES) & ~y) | ((v - SWAR_ONES) & ~v)) & ~w & SWAR_HIGH)
+      break;
+    hi += (((w & SWAR_HIGH) >> 7) * SWAR_ONES) >> 56;
+  }
+
+  for (; p < end; p++)
+  {
+    if (*p & 0x80)
+      hi++;
+    else if ((unsigned char) (*p - 0x21) >= 0x7f - 0x21)
+      break;
+  }
+
+  *hibin += hi;
+  return p - d;
+}
+
 static void update_content_info (CONTENT *info, CONTENT_STATE *s, char *d, size_t dlen)
 {
   int from = s->from;
@@ -539,6 +625,28 @@ static void update_content_info (CONTENT *info, CONTENT_STATE *s, char *d, size_
   {
     char ch = *d;
 
+    /*
+     * Past the start of a line, where "From " and lone dots are
+     * detected, printable and 8-bit characters only need counting.
+     */
+    if (linelen >= 4 && !was_cr)
+    {
+      long hibin = 0;
+      size_t n = content_run (d, dlen, &hibin);
+
+      if (n)
+      {
+	linelen += n;
+	info->hibin += hibin;
+	info->ascii += n - hibin;
+	whitespace = 0;
+	dot = 0;
+	d += n - 1;
+	dlen -= n - 1;
+	continue;
+      }
+    }
+
     if (was_cr)
     {
       was_cr = 0;
@@ -859,6 +967,61 @@ static size_t convert_file_from_to (FILE *file,
   return ret;
 }
 
+/*
+ * The result of scanning a file without charset conversion only depends
+ * on its contents, so remember the last few of them.  Updating the
+ * encoding of an unchanged attachment in the compose menu then doesn't
+ * need to read the whole file again.  Timestamps only have a resolution
+ * of a second, so a file is only remembered if it was last changed in a
+ * second before the one we read it in; otherwise a file rewritten at the
+ * same length, or a new one on a reused inode, could look unchanged.
+ */
+#define CONTENT_CACHE_SIZE 8
+
+static struct content_cache
+{
+  dev_t dev;
+  ino_t ino;
+  LOFF_T size;
+  time_t mtime;
+  time_t ctime;
+  CONTENT info;
+  short valid;
+} ContentCache[CONTENT_CACHE_SIZE];
+
+static int ContentCacheNext = 0;
+
+static struct content_cache *content_cache_find (struct stat *sb)
+{
+  int i;
+
+  for (i = 0; i < CONTENT_CACHE_SIZE; i++)
+    if (ContentCache[i].valid &&
+	ContentCache[i].dev == sb->st_dev &&
+	ContentCache[i].ino == sb->st_ino &&
+	ContentCache[i].size == sb->st_size &&
+	ContentCache[i].mtime == sb->st_mtime &&
+	ContentCache[i].ctime == sb->st_ctime)
+      return &ContentCache[i];
+
+  return NULL;
+}
+
+static void content_cache_add (struct stat *sb, CONTENT *info)
+{
+  struct content_cache *cc = &ContentCache[ContentCacheNext];
+
+  ContentCacheNext = (ContentCacheNext + 1) % CONTENT_CACHE_SIZE;
+
+  cc->dev = sb->st_dev;
+  cc->ino = sb->st_ino;
+  cc->size = sb->st_size;
+  cc->mtime = sb->st_mtime;
+  cc->ctime = sb->st_ctime;
+  memcpy (&cc->info, info, sizeof (CONTENT));
+  cc->valid = 1;
+}
+
 /*
  * Analyze the contents of a file to determine which MIME encoding to use.
  * Also set the body charset, sometimes, or not.
@@ -867,17 +1030,20 @@ CONTENT *mutt_get_content_info (const char *fname, BODY *b)
 {
   CONTENT *info;
   CONTENT_STATE state;
+  struct content_cache *cc;
   FILE *fp = NULL;
   char *fromcode = NULL;
   char *tocode;
-  char buffer[100];
+  char buffer[HUGE_STRING];
   char chsbuf[STRING];
   size_t r;
+  time_t now;
 
   struct stat sb;
 
   if(b && !fname) fname = b->filename;
 
+  now = time (NULL);
   if (stat (fname, &sb) == -1)
   {
     mutt_error (_("Can't stat %s: %s"), fname, strerror (errno));
@@ -922,10 +1088,18 @@ CONTENT *mutt_get_content_info (const char *fname, BODY *b)
     }
   }
 
-  rewind (fp);
-  while ((r = fread (buffer, 1, sizeof(buffer), fp)))
-    update_content_info (info, &state, buffer, r);
-  update_content_info (info, &state, 0, 0);
+  if ((cc = content_cache_find (&sb)) != NULL)
+    memcpy (info, &cc->info, sizeof (CONTENT));
+  else
+  {
+    rewind (fp);
+    while ((r = fread (buffer, 1, sizeof(buffer), fp)))
+      update_content_info (info, &state, buffer, r);
+    update_content_info (info, &state, 0, 0);
+
+    if (!ferror (fp) && sb.st_mtime < now && sb.st_ctime < now)
+      content_cache_add (&sb, info);
+  }
 
   safe_fclose (&fp);
 
@@ -581,40 +581,156 @@ static smime_key_t *smime_parse_key(char *buf)
   return key;
 }
 
-static smime_key_t *smime_get_candidates(char *search, short public)
+/*
+ * The .index files of $smime_certificates and $smime_keys are parsed
+ * once and kept in memory, with hash tables by mailbox and by hash for
+ * the exact lookups.  An index is read again when its file changes.
+ */
+struct smime_index
+{
+  char *file;
+  time_t mtime;
+  off_t size;
+  ino_t ino;
+  time_t loaded;
+  smime_key_t *keys;		/* all records, in file order */
+  HASH *by_email;
+  HASH *by_hash;
+};
+
+static struct smime_index SmimeIndex[2];
+
+static void smime_free_index (struct smime_index *idx)
 {
+  if (idx->by_email)
+    hash_destroy (&idx->by_email, NULL);
+  if (idx->by_hash)
+    hash_destroy (&idx->by_hash, NULL);
+  smime_free_key (&idx->keys);
+  FREE (&idx->file);
+}
+
+static struct smime_index *smime_get_index (short public)
+{
+  struct smime_index *idx = &SmimeIndex[public ? 1 : 0];
   char index_file[_POSIX_PATH_MAX];
-  FILE *fp;
   char buf[LONG_STRING];
-  smime_key_t *key, *results, **results_end;
-
-  results = NULL;
-  results_end = &results;
+  smime_key_t *key, **keys_end, **keyv = NULL;
+  struct stat st;
+  FILE *fp;
+  int n = 0, max = 0;
 
   snprintf(index_file, sizeof (index_file), "%s/.index",
     public ? NONULL(SmimeCertificates) : NONULL(SmimeKeys));
 
-  if ((fp = safe_fopen (index_file, "r")) == NULL)
+  if ((fp = safe_fopen (index_file, "r")) == NULL ||
+      fstat (fileno (fp), &st) == -1)
   {
     mutt_perror (index_file);
+    safe_fclose (&fp);
+    smime_free_index (idx);
     return NULL;
   }
 
+  if (idx->file && !mutt_strcmp (idx->file, index_file) &&
+      idx->mtime == st.st_mtime && idx->size == st.st_size &&
+      idx->ino == st.st_ino && idx->mtime < idx->loaded)
+  {
+    safe_fclose (&fp);
+    return idx;
+  }
+
+  dprint (2, (debugfile, "smime_get_index: reading %s\n", index_file));
+
+  smime_free_index (idx);
+  idx->file = safe_strdup (index_file);
+  idx->mtime = st.st_mtime;
+  idx->size = st.st_size;
+  idx->ino = st.st_ino;
+  /* a change within the second the file was read in would go unnoticed */
+  idx->loaded = time (NULL);
+
+  keys_end = &idx->keys;
   while (fgets (buf, sizeof (buf), fp))
   {
-    if ((! *search) || mutt_stristr (buf, search))
+    if (!(key = smime_parse_key (buf)))
+      continue;
+    *keys_end = key;
+    keys_end = &key->next;
+
+    if (n == max)
     {
-      key = smime_parse_key (buf);
-      if (key)
-      {
-        *results_end = key;
-        results_end = &key->next;
-      }
+      max += 256;
+      safe_realloc (&keyv, max * sizeof (smime_key_t *));
     }
+    keyv[n++] = key;
   }
-
   safe_fclose (&fp);
 
+  idx->by_email = hash_create (MAX (n * 2, 64), 1);
+  idx->by_hash = hash_create (MAX (n * 2, 64), 1);
+
+  /* duplicates go to the head of their chain, so insert them backwards
+   * to find them in file order */
+  while (n-- > 0)
+  {
+    if (keyv[n]->email)
+      hash_insert (idx->by_email, keyv[n]->email, keyv[n], 1);
+    if (keyv[n]->hash)
+      hash_insert (idx->by_hash, keyv[n]->hash, keyv[n], 1);
+  }
+  FREE (&keyv);
+
+  return idx;
+}
+
+/* Returns copies of the records any field of which contains search */
+static smime_key_t *smime_get_candidates(char *search, short public)
+{
+  struct smime_index *idx;
+  smime_key_t *key, *results, **results_end;
+
+  results = NULL;
+  results_end = &results;
+
+  if (!(idx = smime_get_index (public)))
+    return NULL;
+
+  for (key = idx->keys; key; key = key->next)
+  {
+    if ((! *search) ||
+        mutt_stristr (key->email, search) || mutt_stristr (key->hash, search) ||
+        mutt_stristr (key->label, search) || mutt_stristr (key->issuer, search))
+    {
+      *results_end = smime_copy_key (key);
+      results_end = &(*results_end)->next;
+    }
+  }
+
+  return results;
+}
+
+/* Returns copies of the records with exactly this mailbox, or hash */
+static smime_key_t *smime_lookup_index (const char *what, short public,
+                                        short by_hash)
+{
+  struct smime_index *idx;
+  struct hash_elem *elem;
+  HASH *table;
+  smime_key_t *results = NULL, **results_end = &results;
+
+  if (!(idx = smime_get_index (public)))
+    return NULL;
+
+  table = by_hash ? idx->by_hash : idx->by_email;
+  for (elem = hash_find_bucket (table, what); elem; elem = elem->next)
+  {
+    if (table->cmp_string (what, elem->key))
+      continue;
+    *results_end = smime_copy_key ((smime_key_t *) elem->data);
+    results_end = &(*results_end)->next;
+  }
+
   return results;
 }
 
@@ -626,7 +742,7 @@ static smime_key_t *smime_get_key_by_hash(char *hash, short public)
   smime_key_t *results, *result;
   smime_key_t *match = NULL;
 
-  results = smime_get_candidates(hash, public);
+  results = smime_lookup_index (hash, public, 1);
   for (result = results; result; result = result->next)
   {
     if (mutt_strcasecmp (hash, result->hash) == 0)
@@ -655,7 +771,7 @@ static smime_key_t *smime_get_key_by_addr(char *mailbox, short abilities, short
   if (! mailbox)
     return NULL;
 
-  results = smime_get_candidates(mailbox, public);
+  results = smime_lookup_index (mailbox, public, 0);
   for (result = results; result; result = result->next)
   {
     if (abilities && !(result->flags & abilities))
@@ -56,12 +56,19 @@
 #define SMTP_AUTH_UNAVAIL 1
 #define SMTP_AUTH_FAIL    -1
 
+/* commands in flight before we stop to read their responses */
+#define SMTP_PIPELINE_DEPTH 100
+/* size of each BDAT chunk */
+#define SMTP_CHUNK_SIZE 65536
+
 enum {
   STARTTLS,
   AUTH,
   DSN,
   EIGHTBITMIME,
   SMTPUTF8,
+  PIPELINING,
+  CHUNKING,
 
   CAPMAX
 };
@@ -125,6 +132,10 @@ smtp_get_resp (CONNECTION * conn)
       mutt_bit_set (Capabilities, STARTTLS);
     else if (!ascii_strncasecmp ("SMTPUTF8", buf + 4, 8))
       mutt_bit_set (Capabilities, SMTPUTF8);
+    else if (!ascii_strncasecmp ("PIPELINING", buf + 4, 10))
+      mutt_bit_set (Capabilities, PIPELINING);
+    else if (!ascii_strncasecmp ("CHUNKING", buf + 4, 8))
+      mutt_bit_set (Capabilities, CHUNKING);
 
     if (smtp_code (buf, n, &n) < 0)
       return smtp_err_code;
@@ -138,8 +149,49 @@ smtp_get_resp (CONNECTION * conn)
     return -1;
 }
 
+/* Reads the responses to all pipelined commands still in flight, in
+ * the order the commands were sent.  Stops at the first failure. */
+static int
+smtp_flush_resp (CONNECTION * conn, int *pending)
+{
+  int r;
+
+  while (*pending > 0)
+  {
+    (*pending)--;
+    if ((r = smtp_get_resp (conn)))
+      return r;
+  }
+
+  return 0;
+}
+
+/* Accounts for the response to a command just sent.  If the server
+ * advertised PIPELINING, the response is only counted in pending and
+ * read later by smtp_flush_resp (), otherwise it is read right away. */
+static int
+smtp_await_resp (CONNECTION * conn, int *pending)
+{
+  if (!mutt_bit_isset (Capabilities, PIPELINING))
+    return smtp_get_resp (conn);
+
+  /* don't let the server's responses back up indefinitely */
+  if (++(*pending) >= SMTP_PIPELINE_DEPTH)
+    return smtp_flush_resp (conn, pending);
+
+  return 0;
+}
+
+static int
+smtp_command (CONNECTION * conn, const char *buf, int *pending)
+{
+  if (mutt_socket_write (conn, buf) == -1)
+    return smtp_err_write;
+  return smtp_await_resp (conn, pending);
+}
+
 static int
-smtp_rcpt_to (CONNECTION * conn, const ADDRESS * a)
+smtp_rcpt_to (CONNECTION * conn, const ADDRESS * a, int *pending)
 {
   char buf[1024];
   int r;
@@ -157,9 +209,7 @@ smtp_rcpt_to (CONNECTION * conn, const ADDRESS * a)
                 a->mailbox, DsnNotify);
     else
       snprintf (buf, sizeof (buf), "RCPT TO:<%s>\r\n", a->mailbox);
-    if (mutt_socket_write (conn, buf) == -1)
-      return smtp_err_write;
-    if ((r = smtp_get_resp (conn)))
+    if ((r = smtp_command (conn, buf, pending)))
       return r;
     a = a->next;
   }
@@ -168,7 +218,7 @@ smtp_rcpt_to (CONNECTION * conn, const ADDRESS * a)
 }
 
 static int
-smtp_data (CONNECTION * conn, const char *msgfile)
+smtp_data (CONNECTION * conn, const char *msgfile, int *pending)
 {
   char buf[1024];
   FILE *fp = 0;
@@ -188,13 +238,10 @@ smtp_data (CONNECTION * conn, const char *msgfile)
   mutt_progress_init (&progress, _("Sending message..."), MUTT_PROGRESS_SIZE,
                       NetInc, st.st_size);
 
-  snprintf (buf, sizeof (buf), "DATA\r\n");
-  if (mutt_socket_write (conn, buf) == -1)
-  {
-    safe_fclose (&fp);
-    return smtp_err_write;
-  }
-  if ((r = smtp_get_resp (conn)))
+  /* DATA ends a pipelined group: everything up to its 354 has to be
+   * read before the message itself may follow */
+  if ((r = smtp_command (conn, "DATA\r\n", pending)) ||
+      (r = smtp_flush_resp (conn, pending)))
   {
     safe_fclose (&fp);
     return r;
@@ -240,6 +287,93 @@ smtp_data (CONNECTION * conn, const char *msgfile)
 }
 
 
+static int
+smtp_send_chunk (CONNECTION * conn, char *chunk, size_t len, int last,
+                 int *pending)
+{
+  char buf[SHORT_STRING];
+
+  snprintf (buf, sizeof (buf), "BDAT %lu%s\r\n", (unsigned long) len,
+            last ? " LAST" : "");
+  if (mutt_socket_write (conn, buf) == -1)
+    return smtp_err_write;
+  chunk[len] = '\0';
+  if (len && mutt_socket_write_d (conn, chunk, len, MUTT_SOCK_LOG_FULL) == -1)
+    return smtp_err_write;
+
+  return smtp_await_resp (conn, pending);
+}
+
+/* Sends the message with BDAT (RFC 3030) in large chunks, which needs
+ * neither dot-stuffing nor a write per line. */
+static int
+smtp_bdat (CONNECTION * conn, const char *msgfile, int *pending)
+{
+  char buf[LONG_STRING];
+  char *chunk;
+  FILE *fp;
+  progress_t progress;
+  struct stat st;
+  size_t len = 0, n, i;
+  int r = 0, prev = 0;
+
+  fp = fopen (msgfile, "r");
+  if (!fp)
+  {
+    mutt_error (_("SMTP session failed: unable to open %s"), msgfile);
+    return -1;
+  }
+  stat (msgfile, &st);
+  unlink (msgfile);
+  mutt_progress_init (&progress, _("Sending message..."), MUTT_PROGRESS_SIZE,
+                      NetInc, st.st_size);
+
+  chunk = safe_malloc (SMTP_CHUNK_SIZE + 1);
+
+  while ((n = fread (buf, 1, sizeof (buf), fp)) > 0)
+  {
+    for (i = 0; i < n; i++)
+    {
+      if (len + 2 > SMTP_CHUNK_SIZE)
+      {
+        if ((r = smtp_send_chunk (conn, chunk, len, 0, pending)))
+          goto out;
+        len = 0;
+      }
+      if (buf[i] == '\n' && prev != '\r')
+        chunk[len++] = '\r';
+      chunk[len++] = prev = buf[i];
+    }
+    mutt_progress_update (&progress, ftell (fp), -1);
+  }
+
+  /* like smtp_data (), terminate an unterminated last line */
+  if (prev && prev != '\n')
+  {
+    if (len + 2 > SMTP_CHUNK_SIZE)
+    {
+      if ((r = smtp_send_chunk (conn, chunk, len, 0, pending)))
+        goto out;
+      len = 0;
+    }
+    chunk[len++] = '\r';
+    chunk[len++] = '\n';
+  }
+
+  /* a rejected MAIL or RCPT must abort the transaction, so collect every
+   * outstanding response before LAST commits the message */
+  if ((r = smtp_flush_resp (conn, pending)) ||
+      (r = smtp_send_chunk (conn, chunk, len, 1, pending)))
+    goto out;
+  r = smtp_flush_resp (conn, pending);
+
+out:
+  FREE (&chunk);
+  safe_fclose (&fp);
+  return r;
+}
+
+
 /* Returns 1 if a contains at least one 8-bit character, 0 if none do.
  */
 static int address_uses_unicode(const char *a)
@@ -281,7 +415,7 @@ mutt_smtp_send (const ADDRESS* from, const ADDRESS* to, const ADDRESS* cc,
   ACCOUNT account;
   const char* envfrom;
   char buf[1024];
-  int ret = -1;
+  int ret = -1, pending = 0;
 
   /* it might be better to synthesize an envelope from from user and host
    * but this condition is most likely arrived at accidentally */
@@ -326,21 +460,21 @@ mutt_smtp_send (const ADDRESS* from, const ADDRESS* to, const ADDRESS* cc,
 	 addresses_use_unicode(bcc)))
       ret += snprintf (buf + ret, sizeof (buf) - ret, " SMTPUTF8");
     safe_strncat (buf, sizeof (buf), "\r\n", 3);
-    if (mutt_socket_write (conn, buf) == -1)
-    {
-      ret = smtp_err_write;
-      break;
-    }
-    if ((ret = smtp_get_resp (conn)))
+    if ((ret = smtp_command (conn, buf, &pending)))
       break;
 
     /* send the recipient list */
-    if ((ret = smtp_rcpt_to (conn, to)) || (ret = smtp_rcpt_to (conn, cc))
-        || (ret = smtp_rcpt_to (conn, bcc)))
+    if ((ret = smtp_rcpt_to (conn, to, &pending))
+        || (ret = smtp_rcpt_to (conn, cc, &pending))
+        || (ret = smtp_rcpt_to (conn, bcc, &pending)))
       break;
 
     /* send the message data */
-    if ((ret = smtp_data (conn, msgfile)))
+    if (mutt_bit_isset (Capabilities, CHUNKING))
+      ret = smtp_bdat (conn, msgfile, &pending);
+    else
+      ret = smtp_data (conn, msgfile, &pending);
+    if (ret)
       break;
 
     mutt_socket_write (conn, "QUIT\r\n");
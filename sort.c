@@ -23,12 +23,18 @@
 #include "mutt.h"
 #include "sort.h"
 #include "mutt_idna.h"
+#include "stats.h"
 
 #ifdef USE_NNTP
 #include "mx.h"
 #include "nntp.h"
 #endif
 
+#ifdef USE_IMAP
+#include "mx.h"
+#include "imap.h"
+#endif
+
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
@@ -302,6 +308,7 @@ void mutt_sort_headers (CONTEXT *ctx, int init)
   HEADER *h;
   THREAD *thread, *top;
   sort_t *sortfunc;
+  stat_time_t t;
   
   unset_option (OPTNEEDRESORT);
 
@@ -352,7 +359,13 @@ void mutt_sort_headers (CONTEXT *ctx, int init)
       Sort = i;
       unset_option (OPTSORTSUBTHREADS);
     }
+#ifdef USE_IMAP
+    if (ctx->magic == MUTT_IMAP)
+      imap_fetch_envelopes (ctx, 0, ctx->msgcount);
+#endif
+    t = mutt_stats_now ();
     mutt_sort_threads (ctx, init);
+    mutt_stats_add (STAT_THREAD, t);
   }
   else if ((sortfunc = mutt_get_sort_func (Sort)) == NULL ||
 	   (AuxSort = mutt_get_sort_func (SortAux)) == NULL)
@@ -362,7 +375,14 @@ void mutt_sort_headers (CONTEXT *ctx, int init)
     return;
   }
   else 
-    qsort ((void *) ctx->hdrs, ctx->msgcount, sizeof (HEADER *), sortfunc);
+  {
+    t = mutt_stats_now ();
+#ifdef USE_IMAP
+    if (ctx->magic != MUTT_IMAP || imap_sort_headers (ctx) != 0)
+#endif
+      qsort ((void *) ctx->hdrs, ctx->msgcount, sizeof (HEADER *), sortfunc);
+    mutt_stats_add (STAT_SORT, t);
+  }
 
   /* adjust the virtual message numbers */
   ctx->vcount = 0;
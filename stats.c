@@ -0,0 +1,187 @@
+/*
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/*
+ * Cheap always-on timers around the hot paths (mailbox open, header
+ * cache, sorting, threading, patterns, IMAP and the index), so that a
+ * slow session can be diagnosed without a debug build.
+ */
+
+#if HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include "mutt.h"
+#include "mutt_curses.h"
+#include "mx.h"
+#include "stats.h"
+
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+struct stat_entry
+{
+  unsigned long count;
+  stat_time_t total;	/* microseconds */
+  stat_time_t max;
+  unsigned long long bytes;
+};
+
+static struct stat_entry Stats[STAT_MAX];
+
+static const char *TimerNames[] = {
+  "open-mbox",
+  "open-mmdf",
+  "open-mh",
+  "open-maildir",
+  "open-imap",
+  "open-pop",
+  "open-nntp",
+  "open-notmuch",
+  "open-compressed",
+  "hcache-fetch",
+  "hcache-restore",
+  "hcache-store",
+  "thread",
+  "sort",
+  "pattern",
+  "imap-command",
+  "net-read",
+  "net-write",
+  "index-redraw"
+};
+
+stat_time_t mutt_stats_now (void)
+{
+  struct timeval tv;
+
+  gettimeofday (&tv, NULL);
+  return (stat_time_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* account for one event of the given timer which began at start */
+void mutt_stats_add (enum stat_timer t, stat_time_t start)
+{
+  stat_time_t now = mutt_stats_now ();
+  stat_time_t d = now > start ? now - start : 0;
+
+  Stats[t].count++;
+  Stats[t].total += d;
+  if (d > Stats[t].max)
+    Stats[t].max = d;
+}
+
+void mutt_stats_bytes (enum stat_timer t, long n)
+{
+  if (n > 0)
+    Stats[t].bytes += n;
+}
+
+enum stat_timer mutt_stats_open_timer (int magic)
+{
+  switch (magic)
+  {
+    case MUTT_MMDF:
+      return STAT_OPEN_MMDF;
+    case MUTT_MH:
+      return STAT_OPEN_MH;
+    case MUTT_MAILDIR:
+      return STAT_OPEN_MAILDIR;
+    case MUTT_IMAP:
+      return STAT_OPEN_IMAP;
+    case MUTT_POP:
+      return STAT_OPEN_POP;
+#ifdef USE_NNTP
+    case MUTT_NNTP:
+      return STAT_OPEN_NNTP;
+#endif
+    case MUTT_NOTMUCH:
+      return STAT_OPEN_NOTMUCH;
+#ifdef USE_COMPRESSED
+    case MUTT_COMPRESSED:
+      return STAT_OPEN_COMPRESSED;
+#endif
+    default:
+      return STAT_OPEN_MBOX;
+  }
+}
+
+/* one line per timer that has fired:
+ *	<name> <count> <total ms> <average ms> <max ms> <bytes> */
+void mutt_stats_write (FILE *fp)
+{
+  int i;
+
+  for (i = 0; i < STAT_MAX; i++)
+  {
+    if (!Stats[i].count)
+      continue;
+    fprintf (fp, "%-16s %8lu %12.3f %10.3f %10.3f %12llu\n", TimerNames[i],
+	     Stats[i].count, Stats[i].total / 1000.0,
+	     Stats[i].total / 1000.0 / Stats[i].count, Stats[i].max / 1000.0,
+	     Stats[i].bytes);
+  }
+}
+
+/* stats [<file>]: show the timers, or write them to a file */
+int mutt_parse_stats (BUFFER *buf, BUFFER *s, unsigned long data, BUFFER *err)
+{
+  char path[_POSIX_PATH_MAX];
+  FILE *fp;
+
+  if (MoreArgs (s))
+  {
+    mutt_extract_token (buf, s, 0);
+    strfcpy (path, buf->data, sizeof (path));
+    mutt_expand_path (path, sizeof (path));
+    /* replace the file of an earlier run; safe_fopen won't open an
+     * existing one for writing */
+    unlink (path);
+    if ((fp = safe_fopen (path, "w")) == NULL)
+    {
+      snprintf (err->data, err->dsize, "%s: %s", path, strerror (errno));
+      return -1;
+    }
+    mutt_stats_write (fp);
+    safe_fclose (&fp);
+    return 0;
+  }
+
+  if (!option (OPTNOCURSES))
+  {
+    mutt_endwin (NULL);
+    fflush (stdout);
+  }
+  printf ("\n%-16s %8s %12s %10s %10s %12s\n", "timer", "count", "total(ms)",
+	  "avg(ms)", "max(ms)", "bytes");
+  mutt_stats_write (stdout);
+  if (!option (OPTNOCURSES))
+  {
+    set_option (OPTFORCEREDRAWINDEX);
+    set_option (OPTFORCEREDRAWPAGER);
+    mutt_any_key_to_continue (NULL);
+  }
+  return 0;
+}
+
+/* unstats: reset all timers */
+int mutt_parse_unstats (BUFFER *buf, BUFFER *s, unsigned long data, BUFFER *err)
+{
+  memset (Stats, 0, sizeof (Stats));
+  return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ *     This program is free software; you can redistribute it and/or modify
+ *     it under the terms of the GNU General Public License as published by
+ *     the Free Software Foundation; either version 2 of the License, or
+ *     (at your option) any later version.
+ *
+ *     This program is distributed in the hope that it will be useful,
+ *     but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *     GNU General Public License for more details.
+ *
+ *     You should have received a copy of the GNU General Public License
+ *     along with this program; if not, write to the Free Software
+ *     Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _MUTT_STATS_H
+#define _MUTT_STATS_H 1
+
+/* hot-path timers, reported by the "stats" command */
+enum stat_timer
+{
+  STAT_OPEN_MBOX,
+  STAT_OPEN_MMDF,
+  STAT_OPEN_MH,
+  STAT_OPEN_MAILDIR,
+  STAT_OPEN_IMAP,
+  STAT_OPEN_POP,
+  STAT_OPEN_NNTP,
+  STAT_OPEN_NOTMUCH,
+  STAT_OPEN_COMPRESSED,
+  STAT_HCACHE_FETCH,
+  STAT_HCACHE_RESTORE,
+  STAT_HCACHE_STORE,
+  STAT_THREAD,
+  STAT_SORT,
+  STAT_PATTERN,
+  STAT_IMAP_CMD,
+  STAT_NET_READ,
+  STAT_NET_WRITE,
+  STAT_INDEX_REDRAW,
+  /* insert new timers here and in TimerNames[] */
+  STAT_MAX
+};
+
+typedef unsigned long long stat_time_t;
+
+stat_time_t mutt_stats_now (void);
+void mutt_stats_add (enum stat_timer, stat_time_t);
+void mutt_stats_bytes (enum stat_timer, long);
+enum stat_timer mutt_stats_open_timer (int);
+void mutt_stats_write (FILE *);
+
+#endif /* _MUTT_STATS_H */
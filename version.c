@@ -324,6 +324,11 @@ static struct compile_options comp_opts[] =
   { "USE_SSL_OPENSSL", 1 },
 #else
   { "USE_SSL_OPENSSL", 0 },
+#endif
+#ifdef USE_ZLIB
+  { "USE_ZLIB", 1 },
+#else
+  { "USE_ZLIB", 0 },
 #endif
   { NULL, 0 }
 };